@@ -0,0 +1,172 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Timing harness of the benchmarks. Every case runs a few times to warm up,
+// then is timed over a number of repetitions and reported by its median and
+// 99th percentile. Results are printed for people and, when BENCH_JSON names
+// a file, appended to it as one JSON object per line for tracking across
+// commits. BENCH_COMMIT is copied into every object, BENCH_REPETITIONS and
+// BENCH_WARMUP override the counts of every case.
+
+#define BENCH_MAX_REPETITIONS 1000
+
+typedef void (*BENCH_FUNCTION)(void *arg);
+
+struct bench
+{
+    const char *suite;
+    int warmup;
+    int repetitions;
+    FILE *json;
+    const char *commit;
+};
+
+struct bench_stats
+{
+    int repetitions;
+    // Seconds per repetition
+    double min;
+    double median;
+    double p99;
+    double mean;
+};
+
+static inline double bench_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static inline int bench_env_int(const char *name, int value)
+{
+    const char *env = getenv(name);
+    return env && *env ? atoi(env) : value;
+}
+
+/**
+ * \param suite Name of the benchmark program, every result carries it
+ * \param warmup Runs of every case that aren't timed
+ * \param repetitions Timed runs of every case
+ */
+static inline void bench_init(struct bench *bench, const char *suite, int warmup, int repetitions)
+{
+    bench->suite = suite;
+    bench->warmup = bench_env_int("BENCH_WARMUP", warmup);
+    bench->repetitions = bench_env_int("BENCH_REPETITIONS", repetitions);
+    if (bench->repetitions < 1)
+    {
+        bench->repetitions = 1;
+    }
+    else if (bench->repetitions > BENCH_MAX_REPETITIONS)
+    {
+        bench->repetitions = BENCH_MAX_REPETITIONS;
+    }
+
+    const char *json = getenv("BENCH_JSON");
+    bench->json = json && *json ? fopen(json, "a") : NULL;
+    bench->commit = getenv("BENCH_COMMIT");
+}
+
+static inline void bench_finish(struct bench *bench)
+{
+    if (bench->json)
+    {
+        fclose(bench->json);
+    }
+}
+
+static int bench_compare_seconds(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static inline void bench_json_begin(struct bench *bench, const char *name)
+{
+    fprintf(bench->json, "{\"suite\": \"%s\", \"name\": \"%s\"", bench->suite, name);
+    if (bench->commit)
+    {
+        fprintf(bench->json, ", \"commit\": \"%s\"", bench->commit);
+    }
+}
+
+/**
+ * Reports a value that isn't a time, like the memory a structure takes
+ */
+static inline void bench_metric(struct bench *bench, const char *name, double value, const char *unit)
+{
+    printf("%-44s %14.2f %s\n", name, value, unit);
+    if (bench->json)
+    {
+        bench_json_begin(bench, name);
+        fprintf(bench->json, ", \"value\": %.6g, \"unit\": \"%s\"}\n", value, unit);
+    }
+}
+
+/**
+ * Times fn over the repetitions of the bench and reports it.
+ * \param setup Called before every call of fn without being timed, may be NULL
+ * \param units The work one call of fn does, throughput is reported in units per second
+ * \param unit What the units are, "B" for bytes
+ */
+static inline struct bench_stats bench_run_setup(struct bench *bench, const char *name, BENCH_FUNCTION setup, BENCH_FUNCTION fn, void *arg, double units, const char *unit)
+{
+    for (int i = 0; i < bench->warmup; i++)
+    {
+        if (setup)
+        {
+            setup(arg);
+        }
+        fn(arg);
+    }
+
+    double seconds[BENCH_MAX_REPETITIONS];
+    struct bench_stats stats = {.repetitions = bench->repetitions};
+    for (int i = 0; i < stats.repetitions; i++)
+    {
+        if (setup)
+        {
+            setup(arg);
+        }
+        double start = bench_now();
+        fn(arg);
+        seconds[i] = bench_now() - start;
+        stats.mean += seconds[i] / stats.repetitions;
+    }
+
+    qsort(seconds, stats.repetitions, sizeof(double), bench_compare_seconds);
+    stats.min = seconds[0];
+    stats.median = stats.repetitions % 2 ? seconds[stats.repetitions / 2]
+                                         : (seconds[stats.repetitions / 2 - 1] + seconds[stats.repetitions / 2]) / 2;
+    // The smallest time at least 99% of the repetitions took no longer than
+    int p99 = (stats.repetitions * 99 + 99) / 100 - 1;
+    stats.p99 = seconds[p99];
+
+    double throughput = units / stats.median / 1e6;
+    printf("%-44s median %10.3f ms  p99 %10.3f ms  %10.1f %s%s/s\n", name, stats.median * 1e3, stats.p99 * 1e3,
+           throughput, strcmp(unit, "B") == 0 ? "M" : "M ", unit);
+    if (bench->json)
+    {
+        bench_json_begin(bench, name);
+        fprintf(bench->json, ", \"repetitions\": %d, \"warmup\": %d, \"min_ns\": %.0f, \"median_ns\": %.0f, \"p99_ns\": %.0f, \"mean_ns\": %.0f, \"units\": %.0f, \"unit\": \"%s\", \"throughput\": %.6g}\n",
+                stats.repetitions, bench->warmup, stats.min * 1e9, stats.median * 1e9, stats.p99 * 1e9, stats.mean * 1e9,
+                units, unit, units / stats.median);
+    }
+    return stats;
+}
+
+// bench_run_setup without a setup
+static inline struct bench_stats bench_run(struct bench *bench, const char *name, BENCH_FUNCTION fn, void *arg, double units, const char *unit)
+{
+    return bench_run_setup(bench, name, NULL, fn, arg, units, unit);
+}
+
+#endif
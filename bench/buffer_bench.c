@@ -0,0 +1,107 @@
+#include "helpers/buffer.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Emits assembly like lines through buffer_printf into a contiguous buffer
+// and a rope buffer, writes bytes one at a time through buffer_write, then
+// streams the output to /dev/null
+
+#define LINE_COUNT 500000
+#define WRITE_BYTES (8 * 1024 * 1024)
+
+struct emit_case
+{
+    bool rope;
+    struct buffer *buffer;
+};
+
+static void emit(struct buffer *buffer)
+{
+    for (int i = 0; i < LINE_COUNT; i++)
+    {
+        buffer_printf(buffer, "    mov eax, [ebp-%d]\n", i & 0xff);
+    }
+}
+
+static void bench_printf(void *arg)
+{
+    struct emit_case *emit_case = arg;
+    if (emit_case->buffer)
+    {
+        buffer_free(emit_case->buffer);
+    }
+    emit_case->buffer = emit_case->rope ? buffer_create_rope(0) : buffer_create();
+    emit(emit_case->buffer);
+}
+
+static void bench_write(void *arg)
+{
+    struct buffer *buffer = buffer_create();
+    for (int i = 0; i < WRITE_BYTES; i++)
+    {
+        buffer_write(buffer, 'a' + (i & 15));
+    }
+    buffer_free(buffer);
+}
+
+static void bench_writev(void *arg)
+{
+    struct emit_case *emit_case = arg;
+    FILE *out = fopen("/dev/null", "w");
+    buffer_writev(emit_case->buffer, out);
+    fclose(out);
+}
+
+static size_t rope_memory(struct buffer *buffer)
+{
+    size_t total = buffer->msize;
+    for (struct buffer_chunk *chunk = buffer->chunks; chunk; chunk = chunk->next)
+    {
+        total += buffer->chunk_size;
+    }
+    return total;
+}
+
+int main()
+{
+    struct bench bench;
+    bench_init(&bench, "buffer_bench", 1, 10);
+
+    struct emit_case contiguous = {.rope = false};
+    struct emit_case rope = {.rope = true};
+    bench_run(&bench, "buffer_write/bytes", bench_write, NULL, WRITE_BYTES, "B");
+    bench_run(&bench, "buffer_printf/contiguous", bench_printf, &contiguous, LINE_COUNT, "lines");
+    bench_run(&bench, "buffer_printf/rope", bench_printf, &rope, LINE_COUNT, "lines");
+
+    size_t len = buffer_len(contiguous.buffer);
+    bench_run(&bench, "buffer_writev/contiguous", bench_writev, &contiguous, len, "B");
+    bench_run(&bench, "buffer_writev/rope", bench_writev, &rope, len, "B");
+    bench_metric(&bench, "buffer_printf/contiguous/allocated", contiguous.buffer->msize, "bytes");
+    bench_metric(&bench, "buffer_printf/rope/allocated", rope_memory(rope.buffer), "bytes");
+
+    if (buffer_len(rope.buffer) != len || memcmp(buffer_ptr(rope.buffer), buffer_ptr(contiguous.buffer), len) != 0)
+    {
+        fprintf(stderr, "rope and contiguous output differ\n");
+        return 1;
+    }
+
+    // Lines longer than any guess used to be truncated
+    struct buffer *long_line = buffer_create();
+    char text[10000];
+    memset(text, 'x', sizeof(text) - 1);
+    text[sizeof(text) - 1] = 0x00;
+    buffer_printf(long_line, "%s%s", text, text);
+    if (long_line->len != 2 * (sizeof(text) - 1) || strlen(buffer_ptr(long_line)) != long_line->len)
+    {
+        fprintf(stderr, "long line was truncated\n");
+        return 1;
+    }
+
+    buffer_free(long_line);
+    buffer_free(rope.buffer);
+    buffer_free(contiguous.buffer);
+    bench_finish(&bench);
+    return 0;
+}
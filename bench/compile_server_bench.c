@@ -0,0 +1,140 @@
+#include "compiler.h"
+#include "bench.h"
+#include <fcntl.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+// Built by the default make target, the process case is skipped without it
+#define COMPILER_PROGRAM "./main"
+
+// Compiles of many small files one after another: a process per file, a
+// compile of its own per file, and requests to a server that keeps its
+// memory and intern pool warm
+
+#define SOURCE_FILES 64
+#define SOURCE_LINES 400
+#define ROUNDS 4
+
+struct server_case
+{
+    char filenames[SOURCE_FILES][64];
+    compile_server_s *server;
+    size_t source_size;
+    // The requests of one round, all files once
+    char *requests;
+    size_t requests_size;
+    int failed;
+};
+
+extern char **environ;
+
+static void write_source(const char *filename, int file)
+{
+    FILE *fp = fopen(filename, "w");
+    for (int i = 0; i < SOURCE_LINES; i++)
+    {
+        fprintf(fp, "static unsigned long value_%d_%d = (count_%d * %d) + table[index_%d]; // line %d\n", file, i % 31, i % 17, i, i % 13, i);
+    }
+    fclose(fp);
+}
+
+static void bench_cold(void *arg)
+{
+    struct server_case *server_case = arg;
+    for (int round = 0; round < ROUNDS; round++)
+    {
+        for (int i = 0; i < SOURCE_FILES; i++)
+        {
+            server_case->failed += compile_file(server_case->filenames[i], NULL, 0) != COMPILER_FILE_COMPILED_OK;
+        }
+    }
+}
+
+static void bench_process(void *arg)
+{
+    struct server_case *server_case = arg;
+    for (int round = 0; round < ROUNDS; round++)
+    {
+        for (int i = 0; i < SOURCE_FILES; i++)
+        {
+            char *argv[] = {COMPILER_PROGRAM, "-j1", "-o", "/dev/null", server_case->filenames[i], NULL};
+            pid_t pid;
+            int status = 1;
+            posix_spawn_file_actions_t actions;
+            posix_spawn_file_actions_init(&actions);
+            posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+            if (posix_spawn(&pid, COMPILER_PROGRAM, &actions, NULL, argv, environ) == 0)
+            {
+                waitpid(pid, &status, 0);
+            }
+            posix_spawn_file_actions_destroy(&actions);
+            server_case->failed += status != 0;
+        }
+    }
+}
+
+static void bench_warm(void *arg)
+{
+    struct server_case *server_case = arg;
+    FILE *out = fopen("/dev/null", "w");
+    for (int round = 0; round < ROUNDS; round++)
+    {
+        FILE *in = fmemopen(server_case->requests, server_case->requests_size, "r");
+        compile_server_serve(server_case->server, in, out);
+        fclose(in);
+    }
+    fclose(out);
+}
+
+int main()
+{
+    struct server_case server_case = {0};
+    for (int i = 0; i < SOURCE_FILES; i++)
+    {
+        snprintf(server_case.filenames[i], sizeof(server_case.filenames[i]), "/tmp/compile_server_benchXXXXXX");
+        close(mkstemp(server_case.filenames[i]));
+        write_source(server_case.filenames[i], i);
+        struct stat st;
+        stat(server_case.filenames[i], &st);
+        server_case.source_size += st.st_size;
+    }
+
+    FILE *requests = open_memstream(&server_case.requests, &server_case.requests_size);
+    for (int i = 0; i < SOURCE_FILES; i++)
+    {
+        fprintf(requests, "compile %s\n", server_case.filenames[i]);
+    }
+    fclose(requests);
+
+    compile_options_s options = {0};
+    server_case.server = compile_server_create(&options);
+
+    struct bench bench;
+    bench_init(&bench, "compile_server_bench", 1, 10);
+    double total_bytes = (double)ROUNDS * server_case.source_size;
+    if (access(COMPILER_PROGRAM, X_OK) == 0)
+    {
+        bench_run(&bench, "compile/process", bench_process, &server_case, total_bytes, "B");
+    }
+    bench_run(&bench, "compile/cold", bench_cold, &server_case, total_bytes, "B");
+    bench_run(&bench, "compile/server", bench_warm, &server_case, total_bytes, "B");
+    bench_finish(&bench);
+
+    compile_server_free(server_case.server);
+    free(server_case.requests);
+    for (int i = 0; i < SOURCE_FILES; i++)
+    {
+        remove(server_case.filenames[i]);
+    }
+
+    if (server_case.failed)
+    {
+        fprintf(stderr, "%d compiles failed\n", server_case.failed);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,114 @@
+#include "compiler.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// Measures identifiers/sec of keyword recognition, the old strcmp chain
+// against the perfect hash lookup in keyword.c
+
+#define IDENTIFIER_COUNT 4096
+#define ROUNDS 200
+
+static bool is_keyword_strcmp_chain(const char *str)
+{
+    return S_EQ(str, "unsigned") ||
+        S_EQ(str, "signed") ||
+        S_EQ(str, "char") ||
+        S_EQ(str, "short") ||
+        S_EQ(str, "int") ||
+        S_EQ(str, "long") ||
+        S_EQ(str, "float") ||
+        S_EQ(str, "double") ||
+        S_EQ(str, "void") ||
+        S_EQ(str, "struct") ||
+        S_EQ(str, "union") ||
+        S_EQ(str, "static") ||
+        S_EQ(str, "__ignore_typecheck") ||
+        S_EQ(str, "return") ||
+        S_EQ(str, "include") ||
+        S_EQ(str, "sizeof") ||
+        S_EQ(str, "if") ||
+        S_EQ(str, "else") ||
+        S_EQ(str, "while") ||
+        S_EQ(str, "for") ||
+        S_EQ(str, "do") ||
+        S_EQ(str, "break") ||
+        S_EQ(str, "continue") ||
+        S_EQ(str, "switch") ||
+        S_EQ(str, "case") ||
+        S_EQ(str, "default") ||
+        S_EQ(str, "goto") ||
+        S_EQ(str, "typedef") ||
+        S_EQ(str, "const") ||
+        S_EQ(str, "extern") ||
+        S_EQ(str, "restrict");
+}
+
+static char names[IDENTIFIER_COUNT][24];
+static size_t lens[IDENTIFIER_COUNT];
+static volatile int hits;
+
+static void make_identifiers(char names[][24], size_t lens[])
+{
+    static const char *common[] = {"i", "j", "len", "buffer", "token", "process", "vector_push", "result"};
+    srand(1234);
+    for (int i = 0; i < IDENTIFIER_COUNT; i++)
+    {
+        // Roughly one in four identifiers in C code is a keyword
+        if (rand() % 4 == 0)
+        {
+            keyword_e keyword = 1 + rand() % (KEYWORD_COUNT - 1);
+            snprintf(names[i], 24, "%s", keyword_name(keyword));
+        }
+        else
+        {
+            snprintf(names[i], 24, "%s%d", common[rand() % 8], rand() % 100);
+        }
+        lens[i] = strlen(names[i]);
+    }
+}
+
+static void bench_strcmp_chain(void *arg)
+{
+    for (int round = 0; round < ROUNDS; round++)
+    {
+        for (int i = 0; i < IDENTIFIER_COUNT; i++)
+        {
+            hits += is_keyword_strcmp_chain(names[i]);
+        }
+    }
+}
+
+static void bench_perfect_hash(void *arg)
+{
+    for (int round = 0; round < ROUNDS; round++)
+    {
+        for (int i = 0; i < IDENTIFIER_COUNT; i++)
+        {
+            hits += keyword_lookup(names[i], lens[i]) != KEYWORD_NONE;
+        }
+    }
+}
+
+int main()
+{
+    make_identifiers(names, lens);
+
+    // Sanity check the perfect hash agrees with the strcmp chain
+    for (int i = 0; i < IDENTIFIER_COUNT; i++)
+    {
+        if ((keyword_lookup(names[i], lens[i]) != KEYWORD_NONE) != is_keyword_strcmp_chain(names[i]))
+        {
+            fprintf(stderr, "keyword mismatch for %s\n", names[i]);
+            return 1;
+        }
+    }
+
+    struct bench bench;
+    bench_init(&bench, "keyword_bench", 1, 10);
+    double total = (double)IDENTIFIER_COUNT * ROUNDS;
+    bench_run(&bench, "keyword/strcmp_chain", bench_strcmp_chain, NULL, total, "identifiers");
+    bench_run(&bench, "keyword/perfect_hash", bench_perfect_hash, NULL, total, "identifiers");
+    bench_finish(&bench);
+    return 0;
+}
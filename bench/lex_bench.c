@@ -0,0 +1,172 @@
+#include "compiler.h"
+#include "helpers/buffer.h"
+#include "helpers/vector.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Throughput of lex() over generated inputs that each stress one part of
+// the lexer, and of lexing a file mapped into memory against reading it
+// through stdio with COMPILE_PROCESS_FLAG_STDIO_INPUT
+
+#define INPUT_SIZE (4 * 1024 * 1024)
+#define PAREN_DEPTH 64
+#define STRING_LENGTH (256 * 1024)
+
+extern lex_process_functions_s lexer_string_buffer_functions;
+extern lex_process_functions_s compiler_lex_functions;
+
+struct lex_case
+{
+    const char *name;
+    void (*generate)(buffer_s *buf, int i);
+    compile_process_s *compiler;
+    buffer_s *source;
+    size_t total_tokens;
+};
+
+struct input_case
+{
+    const char *filename;
+    int flags;
+    size_t total_tokens;
+};
+
+static void generate_identifiers(buffer_s *buf, int i)
+{
+    buffer_printf_no_terminator(buf, "static unsigned long process_count_%d = token_vector_%d + lexer_state_%d;\n", i % 211, i % 97, i % 13);
+}
+
+static void generate_operators(buffer_s *buf, int i)
+{
+    buffer_printf_no_terminator(buf, "a+=b<<c>>=d&&e||f!=g==h->i++-j%%k^l|m&n*o/p<=q>=r?s:t,~u;\n");
+}
+
+static void generate_comments(buffer_s *buf, int i)
+{
+    buffer_printf_no_terminator(buf, "// a line comment %d that goes on for a while before it ends\n", i);
+    buffer_printf_no_terminator(buf, "/* a block comment\n * over a few lines %d\n */\n", i);
+}
+
+static void generate_parentheses(buffer_s *buf, int i)
+{
+    for (int depth = 0; depth < PAREN_DEPTH; depth++)
+    {
+        buffer_write(buf, '(');
+    }
+    buffer_printf_no_terminator(buf, "x%d", i % 10);
+    for (int depth = 0; depth < PAREN_DEPTH; depth++)
+    {
+        buffer_printf_no_terminator(buf, depth % 8 ? ")" : ")\n");
+    }
+    buffer_write(buf, '\n');
+}
+
+static void generate_strings(buffer_s *buf, int i)
+{
+    buffer_printf_no_terminator(buf, "const char *text_%d = \"", i);
+    for (int c = 0; c < STRING_LENGTH; c++)
+    {
+        buffer_write(buf, c % 1000 == 999 ? '\\' : 'a' + (c + i) % 26);
+        if (c % 1000 == 999)
+        {
+            buffer_write(buf, 'n');
+        }
+    }
+    buffer_printf_no_terminator(buf, "\";\n");
+}
+
+static void bench_lex(void *arg)
+{
+    struct lex_case *lex_case = arg;
+    lex_process_s *lex_process = lex_process_create(lex_case->compiler, &lexer_string_buffer_functions, lex_case->source);
+    lex(lex_process);
+    lex_case->total_tokens = vector_count(lex_process_tokens(lex_process));
+    lex_process_free(lex_process);
+}
+
+// Opening the file is timed as well, that is where the source is mapped
+static void bench_input(void *arg)
+{
+    struct input_case *input_case = arg;
+    compile_process_s *compiler = compile_process_create(input_case->filename, NULL, input_case->flags);
+    lex_process_s *lex_process = lex_process_create(compiler, &compiler_lex_functions, NULL);
+    lex(lex_process);
+    input_case->total_tokens = vector_count(lex_process_tokens(lex_process));
+    lex_process_free(lex_process);
+    compile_process_free(compiler);
+}
+
+static bool bench_inputs(struct bench *bench)
+{
+    char filename[] = "/tmp/lex_benchXXXXXX";
+    close(mkstemp(filename));
+    buffer_s *source = buffer_create();
+    for (int i = 0; source->len < INPUT_SIZE; i++)
+    {
+        generate_identifiers(source, i);
+    }
+    FILE *fp = fopen(filename, "w");
+    fwrite(buffer_ptr(source), 1, source->len, fp);
+    fclose(fp);
+
+    struct input_case mapped = {.filename = filename, .flags = 0};
+    struct input_case stdio = {.filename = filename, .flags = COMPILE_PROCESS_FLAG_STDIO_INPUT};
+    bench_run(bench, "lex/input/mmap", bench_input, &mapped, source->len, "B");
+    bench_run(bench, "lex/input/stdio", bench_input, &stdio, source->len, "B");
+    buffer_free(source);
+    remove(filename);
+
+    if (mapped.total_tokens != stdio.total_tokens)
+    {
+        fprintf(stderr, "lex/input: mmap and stdio give different tokens\n");
+        return false;
+    }
+    return true;
+}
+
+int main()
+{
+    // The compiler only lends its intern pool to the string lexers
+    compile_options_s options = {0};
+    compile_process_s *compiler = compile_process_create_without_file(&options);
+
+    struct lex_case cases[] = {
+        {"lex/identifiers", generate_identifiers},
+        {"lex/operators", generate_operators},
+        {"lex/comments", generate_comments},
+        {"lex/parentheses", generate_parentheses},
+        {"lex/strings", generate_strings},
+    };
+
+    struct bench bench;
+    bench_init(&bench, "lex_bench", 1, 10);
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++)
+    {
+        struct lex_case *lex_case = &cases[c];
+        lex_case->compiler = compiler;
+        lex_case->source = buffer_create();
+        for (int i = 0; lex_case->source->len < INPUT_SIZE; i++)
+        {
+            lex_case->generate(lex_case->source, i);
+        }
+
+        bench_run(&bench, lex_case->name, bench_lex, lex_case, lex_case->source->len, "B");
+        if (lex_case->total_tokens == 0)
+        {
+            fprintf(stderr, "%s: no tokens\n", lex_case->name);
+            return 1;
+        }
+        buffer_free(lex_case->source);
+    }
+
+    if (!bench_inputs(&bench))
+    {
+        return 1;
+    }
+
+    bench_finish(&bench);
+    compile_process_free(compiler);
+    return 0;
+}
@@ -0,0 +1,160 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include "helpers/buffer.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Time to bring the tokens of a file up to date after a small edit in its
+// middle with lex_incremental, next to lexing the edited file again, for
+// growing file sizes
+
+extern lex_process_functions_s lexer_string_buffer_functions;
+
+struct edit
+{
+    const char *name;
+    // Replaces removed bytes at the start of the middle line with text
+    size_t removed;
+    const char *text;
+};
+
+struct edit_case
+{
+    compile_process_s *compiler;
+    struct edit *edit;
+    size_t offset;
+    buffer_s *old_source;
+    buffer_s *new_source;
+    lex_process_s *full;
+    lex_process_s *incremental;
+};
+
+static buffer_s *make_source(int lines, size_t *middle)
+{
+    buffer_s *buf = buffer_create();
+    for (int i = 0; i < lines; i++)
+    {
+        if (i % 1000 == 0)
+        {
+            buffer_printf_no_terminator(buf, "/*\n * Section %d\n */\n", i);
+        }
+        if (i == lines / 2)
+        {
+            *middle = buf->len;
+        }
+        buffer_printf_no_terminator(buf, "    unsigned int value_%d = (count * %d) + buffer[index_%d]; // line %d\n", i % 97, i, i % 13, i);
+    }
+    return buf;
+}
+
+static buffer_s *apply_edit(buffer_s *old, size_t offset, struct edit *edit)
+{
+    buffer_s *buf = buffer_create();
+    buffer_write_bytes(buf, buffer_ptr(old), offset);
+    buffer_write_bytes(buf, edit->text, strlen(edit->text));
+    buffer_write_bytes(buf, (const char *)buffer_ptr(old) + offset + edit->removed, old->len - offset - edit->removed);
+    return buf;
+}
+
+static bool same_tokens(lex_process_s *a, lex_process_s *b)
+{
+    if (vector_count(a->token_vec) != vector_count(b->token_vec) || vector_count(a->brackets) != vector_count(b->brackets))
+    {
+        return false;
+    }
+
+    for (int i = 0; i < vector_count(a->token_vec); i++)
+    {
+        token_s *x = vector_at(a->token_vec, i);
+        token_s *y = vector_at(b->token_vec, i);
+        if (x->type != y->type || x->slice.offset != y->slice.offset || x->slice.length != y->slice.length ||
+            x->pos.line != y->pos.line || x->pos.col != y->pos.col || x->whitespace != y->whitespace ||
+            x->between_brackets != y->between_brackets || x->sid != y->sid || x->llnum != y->llnum)
+        {
+            return false;
+        }
+    }
+    return memcmp(vector_data_ptr(a->brackets), vector_data_ptr(b->brackets), sizeof(lex_brackets_s) * vector_count(a->brackets)) == 0;
+}
+
+static void bench_full(void *arg)
+{
+    struct edit_case *edit_case = arg;
+    if (edit_case->full)
+    {
+        lex_process_free(edit_case->full);
+    }
+    edit_case->full = lex_process_create(edit_case->compiler, &lexer_string_buffer_functions, edit_case->new_source);
+    lex(edit_case->full);
+}
+
+// Lexes the old source and hands the new one to the process
+static void setup_incremental(void *arg)
+{
+    struct edit_case *edit_case = arg;
+    if (edit_case->incremental)
+    {
+        lex_process_free(edit_case->incremental);
+    }
+    edit_case->incremental = lex_process_create(edit_case->compiler, &lexer_string_buffer_functions, edit_case->old_source);
+    lex(edit_case->incremental);
+    edit_case->incremental->private = edit_case->new_source;
+}
+
+static void bench_incremental(void *arg)
+{
+    struct edit_case *edit_case = arg;
+    struct edit *edit = edit_case->edit;
+    lex_incremental(edit_case->incremental, edit_case->offset, edit->removed, strlen(edit->text));
+}
+
+int main()
+{
+    // The compiler only lends its intern pool to the string lexers
+    compile_options_s options = {0};
+    compile_process_s *compiler = compile_process_create_without_file(&options);
+
+    struct edit edits[] = {
+        {"rename", 1, "x"},
+        {"new_line", 0, "    int added = 1;\n"},
+        {"delete", 4, ""},
+        // Everything after it ends up in parentheses, nothing resyncs
+        {"open_paren", 0, "("},
+    };
+
+    struct bench bench;
+    bench_init(&bench, "lex_incremental_bench", 1, 5);
+    for (int lines = 10000; lines <= 100000; lines *= 10)
+    {
+        size_t middle = 0;
+        buffer_s *old_source = make_source(lines, &middle);
+        for (size_t e = 0; e < sizeof(edits) / sizeof(edits[0]); e++)
+        {
+            // Past the indentation, into the identifier
+            struct edit_case edit_case = {.compiler = compiler, .edit = &edits[e], .offset = middle + 17, .old_source = old_source};
+            edit_case.new_source = apply_edit(old_source, edit_case.offset, edit_case.edit);
+
+            char name[64];
+            snprintf(name, sizeof(name), "lex/%d/%s", lines, edits[e].name);
+            bench_run(&bench, name, bench_full, &edit_case, edit_case.new_source->len, "B");
+            snprintf(name, sizeof(name), "lex_incremental/%d/%s", lines, edits[e].name);
+            bench_run_setup(&bench, name, setup_incremental, bench_incremental, &edit_case, edit_case.new_source->len, "B");
+
+            if (!same_tokens(edit_case.full, edit_case.incremental))
+            {
+                fprintf(stderr, "%s: lex_incremental differs from lex\n", edits[e].name);
+                return 1;
+            }
+            lex_process_free(edit_case.incremental);
+            lex_process_free(edit_case.full);
+            buffer_free(edit_case.new_source);
+        }
+        buffer_free(old_source);
+    }
+
+    bench_finish(&bench);
+    compile_process_free(compiler);
+    return 0;
+}
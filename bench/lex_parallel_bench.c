@@ -0,0 +1,89 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include "helpers/threadpool.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Lexing throughput of lex_parallel over one large generated file, from one
+// thread up to the number of CPUs
+
+#define SOURCE_LINES 600000
+
+extern lex_process_functions_s compiler_lex_functions;
+
+struct lex_case
+{
+    const char *filename;
+    threadpool_s *pool;
+    size_t total_tokens;
+};
+
+static void write_source(const char *filename)
+{
+    FILE *fp = fopen(filename, "w");
+    for (int i = 0; i < SOURCE_LINES; i++)
+    {
+        // Multi-line comments and strings make some chunks start in the wrong state
+        if (i % 1000 == 0)
+        {
+            fprintf(fp, "/*\n * Section %d\n * it's generated\n */\n", i);
+        }
+        fprintf(fp, "    unsigned int value_%d = (count * %d) + buffer[index_%d]; // line %d\n", i % 97, i, i % 13, i);
+    }
+    fclose(fp);
+}
+
+static void bench_lex(void *arg)
+{
+    struct lex_case *lex_case = arg;
+    compile_process_s *compiler = compile_process_create(lex_case->filename, NULL, 0);
+    lex_process_s *lex_process = lex_process_create(compiler, &compiler_lex_functions, NULL);
+    lex_parallel(lex_process, lex_case->pool);
+    lex_case->total_tokens = vector_count(lex_process_tokens(lex_process));
+    lex_process_free(lex_process);
+    compile_process_free(compiler);
+}
+
+int main()
+{
+    char filename[] = "/tmp/lex_parallel_benchXXXXXX";
+    close(mkstemp(filename));
+    write_source(filename);
+
+    compile_process_s *compiler = compile_process_create(filename, NULL, 0);
+    size_t size = 0;
+    compile_process_source(compiler, &size);
+    compile_process_free(compiler);
+
+    struct bench bench;
+    bench_init(&bench, "lex_parallel_bench", 1, 3);
+    struct lex_case serial = {.filename = filename};
+    struct bench_stats serial_stats = bench_run(&bench, "lex_parallel/serial", bench_lex, &serial, size, "B");
+
+    // Always go up to a few threads so the stitching is exercised on small machines
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int max_threads = cpus > 4 ? cpus : 4;
+    for (int threads = 1; threads <= max_threads; threads *= 2)
+    {
+        struct lex_case parallel = {.filename = filename, .pool = threadpool_create(threads)};
+        char name[64];
+        snprintf(name, sizeof(name), "lex_parallel/threads/%d", threads);
+        struct bench_stats stats = bench_run(&bench, name, bench_lex, &parallel, size, "B");
+        threadpool_free(parallel.pool);
+
+        if (parallel.total_tokens != serial.total_tokens)
+        {
+            fprintf(stderr, "lex_parallel with %d threads gave %zu tokens instead of %zu\n", threads, parallel.total_tokens, serial.total_tokens);
+            remove(filename);
+            return 1;
+        }
+        snprintf(name, sizeof(name), "lex_parallel/threads/%d/speedup", threads);
+        bench_metric(&bench, name, serial_stats.median / stats.median, "x");
+    }
+
+    bench_finish(&bench);
+    remove(filename);
+    return 0;
+}
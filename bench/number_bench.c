@@ -0,0 +1,127 @@
+#include "compiler.h"
+#include "helpers/buffer.h"
+#include "helpers/vector.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// Throughput of lex() over inputs that are mostly numeric constants, one
+// input per kind of constant the number scanner reads
+
+#define INPUT_SIZE (4 * 1024 * 1024)
+#define NUMBERS_PER_LINE 8
+
+extern lex_process_functions_s lexer_string_buffer_functions;
+
+struct number_case
+{
+    const char *name;
+    void (*generate)(buffer_s *buf, unsigned int i);
+    compile_process_s *compiler;
+    buffer_s *source;
+    size_t total_numbers;
+    size_t expected_numbers;
+};
+
+static void generate_decimal(buffer_s *buf, unsigned int i)
+{
+    buffer_printf_no_terminator(buf, "%u, ", i * 2654435761u);
+}
+
+static void generate_hexadecimal(buffer_s *buf, unsigned int i)
+{
+    buffer_printf_no_terminator(buf, "0x%08X, ", i * 2654435761u);
+}
+
+static void generate_octal_binary(buffer_s *buf, unsigned int i)
+{
+    if (i % 2)
+    {
+        buffer_printf_no_terminator(buf, "0%o, ", i);
+        return;
+    }
+
+    buffer_write(buf, '0');
+    buffer_write(buf, 'b');
+    for (int bit = 15; bit >= 0; bit--)
+    {
+        buffer_write(buf, '0' + ((i >> bit) & 1));
+    }
+    buffer_printf_no_terminator(buf, ", ");
+}
+
+static void generate_floats(buffer_s *buf, unsigned int i)
+{
+    buffer_printf_no_terminator(buf, i % 3 ? "%u.%03ue%d, " : ".%u%ue-%df, ", i % 1000, i % 997, i % 40);
+}
+
+static void generate_suffixed(buffer_s *buf, unsigned int i)
+{
+    static const char *suffixes[] = {"u", "l", "ul", "ll", "ULL", "LU"};
+    buffer_printf_no_terminator(buf, "%u%s, ", i, suffixes[i % 6]);
+}
+
+static void bench_lex_numbers(void *arg)
+{
+    struct number_case *number_case = arg;
+    lex_process_s *lex_process = lex_process_create(number_case->compiler, &lexer_string_buffer_functions, number_case->source);
+    lex(lex_process);
+
+    number_case->total_numbers = 0;
+    vector_s *tokens = lex_process_tokens(lex_process);
+    for (int i = 0; i < vector_count(tokens); i++)
+    {
+        token_s *token = vector_at(tokens, i);
+        number_case->total_numbers += token->type == TOKEN_TYPE_NUMBER;
+    }
+    lex_process_free(lex_process);
+}
+
+int main()
+{
+    // The compiler only lends its intern pool to the string lexers
+    compile_options_s options = {0};
+    compile_process_s *compiler = compile_process_create_without_file(&options);
+
+    struct number_case cases[] = {
+        {"number/decimal", generate_decimal},
+        {"number/hexadecimal", generate_hexadecimal},
+        {"number/octal_binary", generate_octal_binary},
+        {"number/floats", generate_floats},
+        {"number/suffixed", generate_suffixed},
+    };
+
+    struct bench bench;
+    bench_init(&bench, "number_bench", 1, 10);
+    char name[64];
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++)
+    {
+        struct number_case *number_case = &cases[c];
+        number_case->compiler = compiler;
+        number_case->source = buffer_create();
+        for (unsigned int i = 0; number_case->source->len < INPUT_SIZE; i++)
+        {
+            number_case->generate(number_case->source, i);
+            if (i % NUMBERS_PER_LINE == NUMBERS_PER_LINE - 1)
+            {
+                buffer_write(number_case->source, '\n');
+            }
+            number_case->expected_numbers++;
+        }
+
+        bench_run(&bench, number_case->name, bench_lex_numbers, number_case, number_case->source->len, "B");
+        if (number_case->total_numbers != number_case->expected_numbers)
+        {
+            fprintf(stderr, "%s: lexed %zu numbers, expected %zu\n", number_case->name, number_case->total_numbers,
+                    number_case->expected_numbers);
+            return 1;
+        }
+        snprintf(name, sizeof(name), "%s/count", number_case->name);
+        bench_metric(&bench, name, number_case->total_numbers, "numbers");
+        buffer_free(number_case->source);
+    }
+
+    bench_finish(&bench);
+    compile_process_free(compiler);
+    return 0;
+}
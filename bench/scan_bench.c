@@ -0,0 +1,130 @@
+#include "compiler.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Measures MB/s of the character class scanners in scan.c for every
+// instruction set the CPU supports, one token class at a time
+
+#define INPUT_SIZE (8 * 1024 * 1024)
+
+typedef size_t (*SCAN_FUNCTION)(const char *data, size_t size);
+
+struct scan_class
+{
+    const char *name;
+    SCAN_FUNCTION scan;
+    // Shortest and longest run the input is made of
+    int min_length;
+    int max_length;
+    // Characters the runs are made of and the text that ends a run, the
+    // alphabet never forms the terminator
+    const char *alphabet;
+    const char *terminator;
+};
+
+struct scan_case
+{
+    struct scan_class *class;
+    const char *data;
+    size_t *runs;
+    size_t total_runs;
+    size_t scanned;
+};
+
+// Fills the input with runs of the class, every run followed by its terminator
+static size_t make_input(struct scan_class *class, char *data, size_t *runs, size_t max_runs)
+{
+    size_t alphabet_length = strlen(class->alphabet);
+    size_t terminator_length = strlen(class->terminator);
+    size_t size = 0;
+    size_t total_runs = 0;
+    srand(1234);
+    while (total_runs < max_runs)
+    {
+        size_t length = class->min_length + rand() % (class->max_length - class->min_length + 1);
+        if (size + length + terminator_length > INPUT_SIZE)
+        {
+            break;
+        }
+
+        runs[total_runs++] = size;
+        for (size_t i = 0; i < length; i++)
+        {
+            data[size++] = class->alphabet[rand() % alphabet_length];
+        }
+        memcpy(data + size, class->terminator, terminator_length);
+        size += terminator_length;
+    }
+    runs[total_runs] = size;
+    return total_runs;
+}
+
+static void scan_runs(void *arg)
+{
+    struct scan_case *scan_case = arg;
+    size_t total = 0;
+    for (size_t i = 0; i < scan_case->total_runs; i++)
+    {
+        // The scanner sees everything up to the end of the input, as in the lexer
+        size_t start = scan_case->runs[i];
+        total += scan_case->class->scan(scan_case->data + start, scan_case->runs[scan_case->total_runs] - start);
+    }
+    scan_case->scanned = total;
+}
+
+int main()
+{
+    struct scan_class classes[] = {
+        {"identifier", scan_identifier, 1, 24, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_0123456789", "("},
+        {"digits", scan_digits, 1, 10, "0123456789", ";"},
+        {"whitespace", scan_whitespace, 1, 16, " \t", "x"},
+        {"line_comment", scan_line_comment, 8, 100, "abcdefghij klmnopqrstuvwxyz*/;", "\n"},
+        {"block_comment", scan_block_comment, 16, 400, "abcdefghij klmnopqrstuvwxyz*\n;", "*/"},
+    };
+
+    struct bench bench;
+    bench_init(&bench, "scan_bench", 2, 20);
+
+    char *data = malloc(INPUT_SIZE);
+    // Every run takes at least two bytes with its terminator
+    size_t *runs = malloc(sizeof(size_t) * (INPUT_SIZE / 2 + 1));
+    for (size_t c = 0; c < sizeof(classes) / sizeof(classes[0]); c++)
+    {
+        struct scan_class *class = &classes[c];
+        struct scan_case scan_case = {.class = class, .data = data, .runs = runs};
+        scan_case.total_runs = make_input(class, data, runs, INPUT_SIZE / 2);
+
+        size_t expected = 0;
+        for (scan_isa_e isa = SCAN_ISA_SCALAR; isa <= SCAN_ISA_AVX2; isa++)
+        {
+            if (!scan_select(isa))
+            {
+                continue;
+            }
+
+            char name[64];
+            snprintf(name, sizeof(name), "scan/%s/%s", class->name, scan_isa_name(isa));
+            scan_runs(&scan_case);
+            bench_run(&bench, name, scan_runs, &scan_case, scan_case.scanned, "B");
+
+            // Every instruction set has to find the same run ends
+            if (isa == SCAN_ISA_SCALAR)
+            {
+                expected = scan_case.scanned;
+            }
+            else if (scan_case.scanned != expected)
+            {
+                fprintf(stderr, "%s: %s scanned %zu bytes, scalar %zu\n", class->name, scan_isa_name(isa), scan_case.scanned, expected);
+                return 1;
+            }
+        }
+    }
+
+    scan_select(scan_best_isa());
+    free(runs);
+    free(data);
+    bench_finish(&bench);
+    return 0;
+}
@@ -0,0 +1,109 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include "bench.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Time to get the tokens of a large generated file by lexing it against
+// loading them from the token cache
+
+#define SOURCE_LINES 200000
+
+extern lex_process_functions_s compiler_lex_functions;
+
+struct tokens_case
+{
+    const char *filename;
+    // NULL lexes the file
+    token_cache_s *cache;
+    size_t token_count;
+};
+
+static void write_source(const char *filename)
+{
+    FILE *fp = fopen(filename, "w");
+    for (int i = 0; i < SOURCE_LINES; i++)
+    {
+        if (i % 1000 == 0)
+        {
+            fprintf(fp, "/*\n * Section %d\n */\n", i);
+        }
+        fprintf(fp, "    unsigned int value_%d = (count * %d) + buffer[index_%d]; // line %d\n", i % 97, i, i % 13, i);
+    }
+    fclose(fp);
+}
+
+static void remove_directory(const char *directory)
+{
+    DIR *dir = opendir(directory);
+    for (struct dirent *dirent = readdir(dir); dirent; dirent = readdir(dir))
+    {
+        if (dirent->d_name[0] != '.')
+        {
+            char path[512];
+            snprintf(path, sizeof(path), "%s/%s", directory, dirent->d_name);
+            remove(path);
+        }
+    }
+    closedir(dir);
+    rmdir(directory);
+}
+
+// Fills a fresh lex process either way
+static void bench_tokens(void *arg)
+{
+    struct tokens_case *tokens_case = arg;
+    compile_process_s *compiler = compile_process_create(tokens_case->filename, NULL, 0);
+    lex_process_s *lex_process = lex_process_create(compiler, &compiler_lex_functions, NULL);
+    if (!tokens_case->cache || !token_cache_load(tokens_case->cache, lex_process, 0))
+    {
+        lex(lex_process);
+    }
+
+    tokens_case->token_count = vector_count(lex_process_tokens(lex_process));
+    lex_process_free(lex_process);
+    compile_process_free(compiler);
+}
+
+int main()
+{
+    char filename[] = "/tmp/token_cache_benchXXXXXX";
+    close(mkstemp(filename));
+    write_source(filename);
+    char directory[] = "/tmp/token_cache_bench_dirXXXXXX";
+    mkdtemp(directory);
+    token_cache_s *cache = token_cache_create(directory, 0);
+
+    compile_process_s *compiler = compile_process_create(filename, NULL, 0);
+    lex_process_s *lex_process = lex_process_create(compiler, &compiler_lex_functions, NULL);
+    lex(lex_process);
+    token_cache_store(cache, lex_process, 0);
+    size_t size = lex_process->source_size;
+    lex_process_free(lex_process);
+    compile_process_free(compiler);
+
+    struct bench bench;
+    bench_init(&bench, "token_cache_bench", 1, 5);
+    struct tokens_case lexed = {.filename = filename};
+    struct tokens_case cached = {.filename = filename, .cache = cache};
+    struct bench_stats lex_stats = bench_run(&bench, "token_cache/lex", bench_tokens, &lexed, size, "B");
+    struct bench_stats load_stats = bench_run(&bench, "token_cache/load", bench_tokens, &cached, size, "B");
+    bench_metric(&bench, "token_cache/speedup", lex_stats.median / load_stats.median, "x");
+
+    token_cache_stats_s stats;
+    token_cache_stats(cache, &stats);
+    int res = 0;
+    if (cached.token_count != lexed.token_count || stats.hits != bench.warmup + bench.repetitions)
+    {
+        fprintf(stderr, "token cache loaded %zu tokens in %zu hits, lex gave %zu\n", cached.token_count, stats.hits, lexed.token_count);
+        res = 1;
+    }
+
+    bench_finish(&bench);
+    token_cache_free(cache);
+    remove_directory(directory);
+    remove(filename);
+    return res;
+}
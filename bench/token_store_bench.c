@@ -0,0 +1,71 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Compares memory per token and sequential scan speed of the token_s vector
+// against the struct of arrays token_store_s
+
+#define SOURCE_LINES 200000
+
+extern lex_process_functions_s compiler_lex_functions;
+
+static vector_s *tokens;
+static token_store_s *store;
+static volatile size_t identifiers;
+
+static void bench_vector_scan(void *arg)
+{
+    for (int i = 0; i < vector_count(tokens); i++)
+    {
+        token_s *token = vector_at(tokens, i);
+        identifiers += token->type == TOKEN_TYPE_IDENTIFIER;
+    }
+}
+
+static void bench_store_scan(void *arg)
+{
+    for (size_t i = 0; i < token_store_count(store); i++)
+    {
+        identifiers += token_store_type(store, i) == TOKEN_TYPE_IDENTIFIER;
+    }
+}
+
+static void write_source(const char *filename)
+{
+    FILE *fp = fopen(filename, "w");
+    for (int i = 0; i < SOURCE_LINES; i++)
+    {
+        fprintf(fp, "    unsigned int value_%d = (count * %d) + buffer[index_%d]; // line %d\n", i % 97, i, i % 13, i);
+    }
+    fclose(fp);
+}
+
+int main()
+{
+    char filename[] = "/tmp/token_store_benchXXXXXX";
+    close(mkstemp(filename));
+    write_source(filename);
+
+    compile_process_s *compiler = compile_process_create(filename, NULL, 0);
+    lex_process_s *lex_process = lex_process_create(compiler, &compiler_lex_functions, NULL);
+    lex(lex_process);
+    remove(filename);
+
+    store = token_store_create(compiler->interns);
+    token_store_append(store, lex_process);
+
+    tokens = lex_process_tokens(lex_process);
+    size_t count = vector_count(tokens);
+    struct bench bench;
+    bench_init(&bench, "token_store_bench", 2, 20);
+    bench_metric(&bench, "tokens", count, "tokens");
+    bench_metric(&bench, "token_vector/memory", sizeof(token_s), "bytes/token");
+    bench_metric(&bench, "token_store/memory", (double)token_store_memory_usage(store) / count, "bytes/token");
+    bench_run(&bench, "token_vector/scan", bench_vector_scan, NULL, count, "tokens");
+    bench_run(&bench, "token_store/scan", bench_store_scan, NULL, count, "tokens");
+    bench_finish(&bench);
+    return 0;
+}
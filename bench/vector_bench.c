@@ -0,0 +1,118 @@
+#include "helpers/vector.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// Push throughput of helpers/vector from 1e3 to 1e7 elements, growing on
+// demand and with the capacity reserved up front, and the cost of inserting
+// and removing in the middle
+
+#define PUSH_ELEMENTS 1000000
+#define INSERT_ELEMENTS 10000
+#define INSERT_RUN 16
+
+struct bench_element
+{
+    int a;
+    int b;
+    long long c;
+};
+
+struct push_case
+{
+    int total;
+    bool reserve;
+    // Small sizes are repeated so the timer has something to measure
+    int rounds;
+};
+
+static struct vector *make_vector(int total)
+{
+    struct vector *vector = vector_create(sizeof(struct bench_element));
+    for (int i = 0; i < total; i++)
+    {
+        struct bench_element element = {.a = i, .b = -i, .c = i * 3ll};
+        vector_push(vector, &element);
+    }
+    return vector;
+}
+
+static void bench_push(void *arg)
+{
+    struct push_case *push = arg;
+    for (int round = 0; round < push->rounds; round++)
+    {
+        struct vector *vector = vector_create(sizeof(struct bench_element));
+        if (push->reserve)
+        {
+            vector_reserve(vector, push->total);
+        }
+
+        for (int i = 0; i < push->total; i++)
+        {
+            struct bench_element element = {.a = i, .b = -i, .c = i * 3ll};
+            vector_push(vector, &element);
+        }
+
+        if (vector_count(vector) != push->total)
+        {
+            fprintf(stderr, "vector lost elements\n");
+            exit(1);
+        }
+        vector_free(vector);
+    }
+}
+
+// Inserts runs of elements into the middle of a growing vector
+static void bench_insert(void *arg)
+{
+    struct vector *run = make_vector(INSERT_RUN);
+    struct vector *vector = vector_create(sizeof(struct bench_element));
+    for (int i = 0; i < INSERT_ELEMENTS / INSERT_RUN; i++)
+    {
+        vector_insert(vector, run, vector_count(vector) / 2);
+    }
+
+    if (vector_count(vector) != INSERT_ELEMENTS / INSERT_RUN * INSERT_RUN)
+    {
+        fprintf(stderr, "vector_insert lost elements\n");
+        exit(1);
+    }
+    vector_free(vector);
+    vector_free(run);
+}
+
+// Removes every element from the middle of a vector
+static void bench_pop_at(void *arg)
+{
+    struct vector *vector = make_vector(INSERT_ELEMENTS);
+    while (vector_count(vector))
+    {
+        vector_pop_at(vector, vector_count(vector) / 2);
+    }
+    vector_free(vector);
+}
+
+int main()
+{
+    struct bench bench;
+    bench_init(&bench, "vector_bench", 2, 10);
+
+    char name[64];
+    for (int total = 1000; total <= 10000000; total *= 10)
+    {
+        // Every run pushes at least PUSH_ELEMENTS, the largest size only once
+        int rounds = total < PUSH_ELEMENTS ? PUSH_ELEMENTS / total : 1;
+        struct push_case grow = {.total = total, .reserve = false, .rounds = rounds};
+        struct push_case reserve = {.total = total, .reserve = true, .rounds = rounds};
+        snprintf(name, sizeof(name), "vector_push/%d/growing", total);
+        bench_run(&bench, name, bench_push, &grow, (double)total * grow.rounds, "pushes");
+        snprintf(name, sizeof(name), "vector_push/%d/reserved", total);
+        bench_run(&bench, name, bench_push, &reserve, (double)total * reserve.rounds, "pushes");
+    }
+
+    bench_run(&bench, "vector_insert/middle", bench_insert, NULL, INSERT_ELEMENTS / INSERT_RUN, "inserts");
+    bench_run(&bench, "vector_pop_at/middle", bench_pop_at, NULL, INSERT_ELEMENTS, "pops");
+    bench_finish(&bench);
+    return 0;
+}
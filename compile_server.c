@@ -0,0 +1,271 @@
+#include "compiler.h"
+#include "helpers/arena.h"
+#include "helpers/buffer.h"
+#include "helpers/intern.h"
+#include "helpers/allocator.h"
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// The warm block of the request arena starts at this size and grows to what
+// the largest request needed, up to COMPILE_SERVER_MAX_ARENA_BLOCK
+#define COMPILE_SERVER_ARENA_BLOCK (4 * 1024 * 1024)
+#define COMPILE_SERVER_MAX_ARENA_BLOCK (256 * 1024 * 1024)
+// The intern pool is started over once it holds this many lexemes
+#define COMPILE_SERVER_MAX_INTERNS (1 << 20)
+#define COMPILE_SERVER_BACKLOG 16
+
+struct compile_server
+{
+    compile_options_s options;
+
+    // Everything a request allocates comes from here and is released at
+    // once when it is done. The lock makes it safe for the lexing pool.
+    arena_s *arena;
+    arena_mark_s mark;
+    pthread_mutex_t arena_lock;
+    allocator_s allocator;
+
+    intern_pool_s *interns;
+    diagnostics_s *diagnostics;
+    // The diagnostics of a request as they are sent back
+    buffer_s *response;
+    char request[COMPILE_SERVER_MAX_REQUEST];
+};
+
+static void *compile_server_alloc(void *context, size_t size)
+{
+    compile_server_s *server = context;
+    pthread_mutex_lock(&server->arena_lock);
+    void *ptr = arena_alloc(server->arena, size);
+    pthread_mutex_unlock(&server->arena_lock);
+    return ptr;
+}
+
+static void *compile_server_realloc(void *context, void *ptr, size_t old_size, size_t new_size)
+{
+    compile_server_s *server = context;
+    pthread_mutex_lock(&server->arena_lock);
+    void *new_ptr = arena_realloc(server->arena, ptr, old_size, new_size);
+    pthread_mutex_unlock(&server->arena_lock);
+    return new_ptr;
+}
+
+static void compile_server_free_memory(void *context, void *ptr, size_t size)
+{
+    // Released with the rest of the request
+    (void)context;
+    (void)ptr;
+    (void)size;
+}
+
+static void compile_server_create_arena(compile_server_s *server, size_t block_size)
+{
+    server->arena = arena_create(block_size);
+    server->mark = arena_mark(server->arena);
+}
+
+compile_server_s *compile_server_create(compile_options_s *options)
+{
+    compile_server_s *server = calloc(1, sizeof(compile_server_s));
+    server->options = *options;
+    compile_server_create_arena(server, COMPILE_SERVER_ARENA_BLOCK);
+    pthread_mutex_init(&server->arena_lock, NULL);
+    server->allocator = (allocator_s){
+        .alloc = compile_server_alloc,
+        .realloc = compile_server_realloc,
+        .free = compile_server_free_memory,
+        .context = server,
+    };
+    server->interns = intern_pool_create();
+    server->diagnostics = diagnostics_create(DIAGNOSTICS_DEFAULT_CAPACITY, DIAGNOSTICS_DEFAULT_TEXT_SIZE);
+    server->response = buffer_create();
+
+    server->options.allocator = &server->allocator;
+    server->options.interns = server->interns;
+    server->options.diagnostics = server->diagnostics;
+    // Stats are per compile, a server has no one to hand them to
+    server->options.stats = NULL;
+    return server;
+}
+
+void compile_server_free(compile_server_s *server)
+{
+    buffer_free(server->response);
+    diagnostics_free(server->diagnostics);
+    intern_pool_free(server->interns);
+    pthread_mutex_destroy(&server->arena_lock);
+    arena_free(server->arena);
+    free(server);
+}
+
+// Gets the server ready for the next request, keeping what is worth keeping
+static void compile_server_reset(compile_server_s *server)
+{
+    arena_s *arena = server->arena;
+    if (arena->total_size > arena->block_size && arena->block_size < COMPILE_SERVER_MAX_ARENA_BLOCK)
+    {
+        // The request didn't fit in the warm block, make it big enough for the next one like it
+        size_t block_size = arena->total_size < COMPILE_SERVER_MAX_ARENA_BLOCK ? arena->total_size : COMPILE_SERVER_MAX_ARENA_BLOCK;
+        arena_free(arena);
+        compile_server_create_arena(server, block_size);
+    }
+    else
+    {
+        arena_rewind(arena, server->mark);
+    }
+
+    if (intern_pool_count(server->interns) > COMPILE_SERVER_MAX_INTERNS)
+    {
+        intern_pool_free(server->interns);
+        server->interns = intern_pool_create();
+        server->options.interns = server->interns;
+    }
+    diagnostics_clear(server->diagnostics);
+    buffer_clear(server->response);
+}
+
+static void compile_server_respond(FILE *out, const char *status, const char *body, size_t len)
+{
+    fprintf(out, "%s %zu\n", status, len);
+    fwrite(body, 1, len, out);
+    fflush(out);
+}
+
+static void compile_server_compile(compile_server_s *server, const char *filename, const char *filename_out, FILE *out)
+{
+    int res = compile_file_with_options(filename, filename_out, &server->options);
+    diagnostics_write(server->diagnostics, server->response);
+    if (res != COMPILER_FILE_COMPILED_OK && server->response->len == 0)
+    {
+        buffer_printf(server->response, "%s: could not be compiled\n", filename);
+    }
+
+    compile_server_respond(out, res == COMPILER_FILE_COMPILED_OK ? "ok" : "failed", buffer_ptr(server->response),
+                           server->response->len);
+    compile_server_reset(server);
+}
+
+static void compile_server_error(FILE *out, const char *message)
+{
+    compile_server_respond(out, "error", message, strlen(message));
+}
+
+bool compile_server_serve(compile_server_s *server, FILE *in, FILE *out)
+{
+    while (fgets(server->request, sizeof(server->request), in))
+    {
+        char *end = strchr(server->request, '\n');
+        if (!end && !feof(in))
+        {
+            // Throw away the rest of the line so the next request starts in the right place
+            int c;
+            while ((c = fgetc(in)) != EOF && c != '\n')
+            {
+            }
+            compile_server_error(out, "request too long\n");
+            continue;
+        }
+        if (end)
+        {
+            *end = 0x00;
+        }
+
+        char *saveptr = NULL;
+        char *command = strtok_r(server->request, " \t\r", &saveptr);
+        if (!command)
+        {
+            continue;
+        }
+
+        if (S_EQ(command, "shutdown"))
+        {
+            compile_server_respond(out, "ok", "", 0);
+            return true;
+        }
+
+        if (!S_EQ(command, "compile"))
+        {
+            compile_server_error(out, "unknown request\n");
+            continue;
+        }
+
+        const char *filename = strtok_r(NULL, " \t\r", &saveptr);
+        const char *filename_out = strtok_r(NULL, " \t\r", &saveptr);
+        if (!filename || strtok_r(NULL, " \t\r", &saveptr))
+        {
+            compile_server_error(out, "usage: compile file.c [output]\n");
+            continue;
+        }
+        compile_server_compile(server, filename, filename_out, out);
+    }
+    return false;
+}
+
+int compile_server_listen(compile_server_s *server, const char *socket_path)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(socket_path) >= sizeof(addr.sun_path))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    unlink(socket_path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, COMPILE_SERVER_BACKLOG) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    // A client that hangs up before reading its answer must not take the server down
+    signal(SIGPIPE, SIG_IGN);
+    bool shutdown = false;
+    while (!shutdown)
+    {
+        int client = accept(fd, NULL, NULL);
+        if (client < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+
+        FILE *in = fdopen(client, "r");
+        FILE *out = fdopen(dup(client), "w");
+        if (in && out)
+        {
+            shutdown = compile_server_serve(server, in, out);
+        }
+
+        if (in)
+        {
+            fclose(in);
+        }
+        else
+        {
+            close(client);
+        }
+        if (out)
+        {
+            fclose(out);
+        }
+    }
+
+    close(fd);
+    unlink(socket_path);
+    return shutdown ? 0 : -1;
+}
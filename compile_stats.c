@@ -0,0 +1,101 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <time.h>
+
+static const char *compile_phase_names[COMPILE_PHASE_COUNT] = {
+    [COMPILE_PHASE_READ] = "read",
+    [COMPILE_PHASE_LEX] = "lex",
+    [COMPILE_PHASE_PARSE] = "parse",
+    [COMPILE_PHASE_CODEGEN] = "codegen",
+};
+
+static double compile_stats_seconds(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void compile_stats_clock(compile_phase_time_s *now)
+{
+    now->wall = compile_stats_seconds(CLOCK_MONOTONIC);
+    // Other files may be compiled on other threads at the same time
+    now->cpu = compile_stats_seconds(CLOCK_THREAD_CPUTIME_ID);
+}
+
+void compile_stats_end_phase(compile_stats_s *stats, compile_phase_e phase, compile_phase_time_s *start)
+{
+    if (!stats)
+    {
+        return;
+    }
+
+    compile_phase_time_s now;
+    compile_stats_clock(&now);
+    stats->phases[phase].wall += now.wall - start->wall;
+    stats->phases[phase].cpu += now.cpu - start->cpu;
+    *start = now;
+}
+
+void compile_stats_count_tokens(compile_stats_s *stats, vector_s *token_vec)
+{
+    // Counted once lexing is done so the lexer itself pays nothing
+    for (int i = 0; i < vector_count(token_vec); i++)
+    {
+        token_s *token = vector_at(token_vec, i);
+        if (token->type < TOKEN_TYPE_COUNT)
+        {
+            stats->tokens[token->type]++;
+        }
+    }
+}
+
+static void compile_stats_print_string(const char *str, FILE *fp)
+{
+    fputc('"', fp);
+    for (const char *c = str; *c; c++)
+    {
+        if (*c == '"' || *c == '\\')
+        {
+            fputc('\\', fp);
+        }
+
+        if ((unsigned char)*c < 0x20)
+        {
+            fprintf(fp, "\\u%04x", *c);
+            continue;
+        }
+        fputc(*c, fp);
+    }
+    fputc('"', fp);
+}
+
+void compile_stats_print_json(compile_stats_s *stats, const char *filename, FILE *fp)
+{
+    fprintf(fp, "{\"file\": ");
+    compile_stats_print_string(filename, fp);
+
+    fprintf(fp, ", \"phases\": {");
+    for (int i = 0; i < COMPILE_PHASE_COUNT; i++)
+    {
+        fprintf(fp, "%s\"%s\": {\"wall_ms\": %.3f, \"cpu_ms\": %.3f}", i ? ", " : "", compile_phase_names[i],
+                stats->phases[i].wall * 1e3, stats->phases[i].cpu * 1e3);
+    }
+
+    fprintf(fp, "}, \"bytes_read\": %zu, \"token_cache_hit\": %s, \"tokens\": {", stats->bytes_read,
+            stats->token_cache_hit ? "true" : "false");
+    size_t total_tokens = 0;
+    for (int i = 0; i < TOKEN_TYPE_COUNT; i++)
+    {
+        fprintf(fp, "\"%s\": %zu, ", token_type_name(i), stats->tokens[i]);
+        total_tokens += stats->tokens[i];
+    }
+
+    fprintf(fp, "\"total\": %zu}, \"buffer_creates\": %zu, \"vector_reallocs\": %zu, \"bytes_allocated\": %zu",
+            total_tokens, stats->helpers.buffer_creates, stats->helpers.vector_reallocs, stats->helpers.bytes_allocated);
+
+    struct intern_stats *interns = &stats->interns;
+    double hit_rate = interns->lookups ? (double)interns->hits / interns->lookups : 0.0;
+    fprintf(fp, ", \"interns\": {\"lookups\": %zu, \"hits\": %zu, \"hit_rate\": %.4f, \"unique\": %zu, \"bytes_stored\": %zu, \"bytes_saved\": %zu}}\n",
+            interns->lookups, interns->hits, hit_rate, interns->unique, interns->bytes_stored, interns->bytes_saved);
+}
@@ -1,58 +1,155 @@
 #include "compiler.h"
+#include "helpers/buffer.h"
 #include <stdarg.h>
 #include <stdlib.h>
 
 lex_process_functions_s compiler_lex_functions =
 {
-    .next_char = compile_process_next_char,
-    .peek_char = compile_process_peek_char,
-    .push_char = compile_process_push_char
+    .fill = compile_process_fill,
+    .source = compile_process_lex_source
 };
 
+static void compiler_diagnostic(compile_process_s *compiler, diagnostic_severity_e severity, const char *msg, va_list args)
+{
+    diagnostics_report(compiler->diagnostics, severity, compiler->pos, msg, args);
+}
+
 void compile_error(compile_process_s *compiler, const char *msg, ...)
 {
+    if (compiler->error_jmp)
+    {
+        longjmp(*compiler->error_jmp, 1);
+    }
+
     va_list args;
     va_start(args, msg);
-    vfprintf(stderr, msg, args);
+    compiler_diagnostic(compiler, DIAGNOSTIC_ERROR, msg, args);
     va_end(args);
-    fprintf(stderr, " on line %i, col %i in file %s\n", compiler->pos.line, compiler->pos.col, compiler->pos.filename);
+
+    // Unwind the phase, whoever set the handler decides how to go on
+    if (compiler->failure_jmp)
+    {
+        longjmp(*compiler->failure_jmp, 1);
+    }
+
+    // Only a caller lexing on its own with lex_next gets here, we are about
+    // to exit, don't lose what was collected so far
+    if (compiler->diagnostics)
+    {
+        diagnostics_print(compiler->diagnostics, stderr);
+    }
     exit(-1);
 }
 
 void compile_warning(compile_process_s *compiler, const char *msg, ...)
 {
+    // A speculative chunk can't tell a warning from lexing in the wrong
+    // state either, the serial lexer reports it
+    if (compiler->error_jmp)
+    {
+        longjmp(*compiler->error_jmp, 1);
+    }
+
+    compiler->warnings++;
     va_list args;
     va_start(args, msg);
-    vfprintf(stderr, msg, args);
+    compiler_diagnostic(compiler, DIAGNOSTIC_WARNING, msg, args);
     va_end(args);
-    fprintf(stderr, " on line %i, col %i in file %s\n", compiler->pos.line, compiler->pos.col, compiler->pos.filename);
 }
 
 int compile_file(const char *filename, const char *filename_out, int flags)
 {
-    compile_process_s *process = compile_process_create(filename, filename_out, flags);
+    compile_options_s options = {.flags = flags};
+    return compile_file_with_options(filename, filename_out, &options);
+}
+
+static int compile_file_phases(const char *filename, const char *filename_out, compile_options_s *options)
+{
+    compile_stats_s *stats = options->stats;
+    compile_phase_time_s clock;
+    if (stats)
+    {
+        compile_stats_clock(&clock);
+    }
+
+    compile_process_s *process = compile_process_create_options(filename, filename_out, options);
     if (NULL == process)
     {
         return COMPILER_FAILED_WITH_ERRORS;
     }
+    process->diagnostics = options->diagnostics;
+    process->stats = stats;
+    compile_stats_end_phase(stats, COMPILE_PHASE_READ, &clock);
 
     // Perform lexical analysis
     lex_process_s *lex_process = lex_process_create(process, &compiler_lex_functions, NULL);
     if (NULL == lex_process)
     {
+        compile_process_free(process);
         return COMPILER_FAILED_WITH_ERRORS;
     }
 
-    if (lex(lex_process) != LEXICAL_ANALYSIS_ALL_OK)
+    // An error fails this file only, a driver or server goes on with the next
+    jmp_buf failure_jmp;
+    process->failure_jmp = &failure_jmp;
+    if (setjmp(failure_jmp))
     {
+        lex_process_free(lex_process);
+        compile_process_free(process);
         return COMPILER_FAILED_WITH_ERRORS;
     }
 
+    int res = COMPILER_FILE_COMPILED_OK;
+    // The same source with the same flags always gives the same tokens
+    bool cached = options->token_cache && token_cache_load(options->token_cache, lex_process, options->flags);
+    if (!cached)
+    {
+        if (lex_parallel(lex_process, options->pool) != LEXICAL_ANALYSIS_ALL_OK)
+        {
+            res = COMPILER_FAILED_WITH_ERRORS;
+        }
+        else if (options->token_cache)
+        {
+            token_cache_store(options->token_cache, lex_process, options->flags);
+        }
+    }
+
     process->token_vec = lex_process->token_vec;
+    compile_stats_end_phase(stats, COMPILE_PHASE_LEX, &clock);
 
     // Perform parsing
+    compile_stats_end_phase(stats, COMPILE_PHASE_PARSE, &clock);
 
     // Perform code generation
+    compile_stats_end_phase(stats, COMPILE_PHASE_CODEGEN, &clock);
+
+    if (stats)
+    {
+        // Input read through stdio is only read as it is lexed
+        stats->bytes_read = process->cfile.bytes_read;
+        stats->token_cache_hit = cached;
+        intern_pool_stats(process->interns, &stats->interns);
+        compile_stats_count_tokens(stats, process->token_vec);
+    }
+
+    // A driver may compile thousands of files in one process, release
+    // the mapped source and everything the lexer allocated
+    process->token_vec = NULL;
+    lex_process_free(lex_process);
+    compile_process_free(process);
+    return res;
+}
+
+int compile_file_with_options(const char *filename, const char *out_filename, compile_options_s *options)
+{
+    if (NULL == options->stats)
+    {
+        return compile_file_phases(filename, out_filename, options);
+    }
 
-    return COMPILER_FILE_COMPILED_OK;
+    // Whatever the helpers allocate until we are done counts toward this file
+    struct helper_stats *previous = helper_stats_swap(&options->stats->helpers);
+    int res = compile_file_phases(filename, out_filename, options);
+    helper_stats_swap(previous);
+    return res;
 }
@@ -3,7 +3,12 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include "helpers/stats.h"
+#include "helpers/intern.h"
 
 #define S_EQ(str, str2) \
     ((str) && (str2) && strcmp(str, str2) == 0)
@@ -51,6 +56,13 @@
 
 typedef struct vector vector_s;
 typedef struct buffer buffer_s;
+typedef struct intern_pool intern_pool_s;
+typedef struct arena arena_s;
+typedef struct arena_mark arena_mark_s;
+typedef struct threadpool threadpool_s;
+typedef struct token_cache token_cache_s;
+typedef struct compile_server compile_server_s;
+typedef struct allocator allocator_s;
 
 typedef struct _pos_s
 {
@@ -71,6 +83,8 @@ typedef enum _token_type_e
     TOKEN_TYPE_NEWLINE
 } token_type_e;
 
+#define TOKEN_TYPE_COUNT (TOKEN_TYPE_NEWLINE + 1)
+
 typedef enum _token_number_type_e
 {
     NUMBER_TYPE_NORMAL,
@@ -79,6 +93,102 @@ typedef enum _token_number_type_e
     NUMBER_TYPE_DOUBLE
 } token_number_type_e;
 
+typedef enum _keyword_e
+{
+    KEYWORD_NONE,
+    KEYWORD_UNSIGNED,
+    KEYWORD_SIGNED,
+    KEYWORD_CHAR,
+    KEYWORD_SHORT,
+    KEYWORD_INT,
+    KEYWORD_LONG,
+    KEYWORD_FLOAT,
+    KEYWORD_DOUBLE,
+    KEYWORD_VOID,
+    KEYWORD_STRUCT,
+    KEYWORD_UNION,
+    KEYWORD_STATIC,
+    KEYWORD_IGNORE_TYPECHECK,
+    KEYWORD_RETURN,
+    KEYWORD_INCLUDE,
+    KEYWORD_SIZEOF,
+    KEYWORD_IF,
+    KEYWORD_ELSE,
+    KEYWORD_WHILE,
+    KEYWORD_FOR,
+    KEYWORD_DO,
+    KEYWORD_BREAK,
+    KEYWORD_CONTINUE,
+    KEYWORD_SWITCH,
+    KEYWORD_CASE,
+    KEYWORD_DEFAULT,
+    KEYWORD_GOTO,
+    KEYWORD_TYPEDEF,
+    KEYWORD_CONST,
+    KEYWORD_EXTERN,
+    KEYWORD_RESTRICT,
+    KEYWORD_COUNT
+} keyword_e;
+
+typedef enum _operator_e
+{
+    OPERATOR_NONE,
+    OPERATOR_PLUS,
+    OPERATOR_MINUS,
+    OPERATOR_MULTIPLY,
+    OPERATOR_DIVIDE,
+    OPERATOR_MODULO,
+    OPERATOR_LOGICAL_NOT,
+    OPERATOR_BITWISE_XOR,
+    OPERATOR_BITWISE_NOT,
+    OPERATOR_QUESTION,
+    OPERATOR_ASSIGN,
+    OPERATOR_LESS,
+    OPERATOR_GREATER,
+    OPERATOR_BITWISE_OR,
+    OPERATOR_BITWISE_AND,
+    OPERATOR_LEFT_PAREN,
+    OPERATOR_LEFT_BRACKET,
+    OPERATOR_COMMA,
+    OPERATOR_DOT,
+    OPERATOR_PLUS_ASSIGN,
+    OPERATOR_MINUS_ASSIGN,
+    OPERATOR_MULTIPLY_ASSIGN,
+    OPERATOR_DIVIDE_ASSIGN,
+    OPERATOR_MODULO_ASSIGN,
+    OPERATOR_XOR_ASSIGN,
+    OPERATOR_OR_ASSIGN,
+    OPERATOR_AND_ASSIGN,
+    OPERATOR_LEFT_SHIFT_ASSIGN,
+    OPERATOR_RIGHT_SHIFT_ASSIGN,
+    OPERATOR_LEFT_SHIFT,
+    OPERATOR_RIGHT_SHIFT,
+    OPERATOR_LESS_EQUAL,
+    OPERATOR_GREATER_EQUAL,
+    OPERATOR_EQUAL,
+    OPERATOR_NOT_EQUAL,
+    OPERATOR_LOGICAL_AND,
+    OPERATOR_LOGICAL_OR,
+    OPERATOR_INCREMENT,
+    OPERATOR_DECREMENT,
+    OPERATOR_ARROW,
+    OPERATOR_ELLIPSIS,
+    OPERATOR_COUNT
+} operator_e;
+
+enum
+{
+    // The token text is only kept as its slice of the source and sval isn't set,
+    // use lex_process_token_text to read it.
+    TOKEN_FLAG_SOURCE_SLICE = 0b00000001,
+    // Suffixes of number tokens beyond what token_number_type_e tells
+    TOKEN_FLAG_NUMBER_UNSIGNED = 0b00000010,    ///< 'u', any integer type
+    TOKEN_FLAG_NUMBER_LONG_LONG = 0b00000100,   ///< "ll", the type is NUMBER_TYPE_LONG
+    TOKEN_FLAG_NUMBER_LONG_DOUBLE = 0b00001000  ///< 'l' on a floating constant, the type is NUMBER_TYPE_DOUBLE
+};
+
+#define TOKEN_FLAG_NUMBER_MASK (TOKEN_FLAG_NUMBER_UNSIGNED | TOKEN_FLAG_NUMBER_LONG_LONG | TOKEN_FLAG_NUMBER_LONG_DOUBLE)
+
 typedef struct _token_s
 {
     int type;
@@ -92,6 +202,7 @@ typedef struct _token_s
         unsigned int inum;
         unsigned long lnum;
         unsigned long long llnum;
+        double dnum; ///< Value of NUMBER_TYPE_FLOAT and NUMBER_TYPE_DOUBLE numbers
         void *any;
     };
 
@@ -100,10 +211,30 @@ typedef struct _token_s
         token_number_type_e type;
     } num;
 
+    // The bytes of the source this token was read from, delimiters included
+    struct token_slice
+    {
+        unsigned int offset;
+        unsigned int length;
+    } slice;
+
+    // Intern id of sval for identifier, keyword and string tokens,
+    // equal ids mean equal text within the same compile process.
+    unsigned int sid;
+
+    union
+    {
+        keyword_e keyword; ///< The keyword id of TOKEN_TYPE_KEYWORD tokens
+        operator_e op;     ///< The operator id of TOKEN_TYPE_OPERATOR tokens
+    };
+
     // True if their is whitespace between the token and the next token
     // i.e. * a for operator token * would mean whitespace would be set for token "a"
     bool whitespace;
-    const char *between_brackets;
+
+    // Index + 1 into lex_process_s::brackets of the outermost parentheses
+    // this token is in, 0 if it isn't in any
+    int between_brackets;
 } token_s;
 
 typedef enum _compiler_result_e
@@ -118,12 +249,157 @@ typedef enum _lex_result_e
     LEXICAL_ANALYSIS_INPUT_ERROR
 } lex_result_e;
 
+// Classes, states and actions of the table driven dispatch in read_next_token.
+// The tables are generated at build time by tools/lexer_gen.c.
+typedef enum _lexer_class_e
+{
+    LEXER_CLASS_OTHER,
+    LEXER_CLASS_DIGIT,
+    LEXER_CLASS_LETTER,
+    LEXER_CLASS_DOT, ///< Starts a floating constant when a digit follows
+    LEXER_CLASS_OPERATOR,
+    LEXER_CLASS_STAR,
+    LEXER_CLASS_SLASH,
+    LEXER_CLASS_SYMBOL,
+    LEXER_CLASS_DOUBLE_QUOTE,
+    LEXER_CLASS_SINGLE_QUOTE,
+    LEXER_CLASS_WHITESPACE,
+    LEXER_CLASS_NEWLINE,
+    LEXER_CLASS_EOF,
+    LEXER_CLASS_COUNT
+} lexer_class_e;
+
+typedef enum _lexer_state_e
+{
+    LEXER_STATE_START,
+    LEXER_STATE_SLASH, ///< After a '/', either a comment or the division operator
+    LEXER_STATE_DOT,   ///< After a '.', either a floating constant or an operator
+    LEXER_STATE_COUNT
+} lexer_state_e;
+
+// A transition to LEXER_STATE_COUNT or above runs the action of that value
+// minus LEXER_STATE_COUNT, anything below moves to that state
+typedef enum _lexer_action_e
+{
+    LEXER_ACTION_INVALID,
+    LEXER_ACTION_END,
+    LEXER_ACTION_NUMBER,
+    LEXER_ACTION_DOT,
+    LEXER_ACTION_IDENTIFIER,
+    LEXER_ACTION_OPERATOR_OR_STRING,
+    LEXER_ACTION_DIVISION,
+    LEXER_ACTION_SYMBOL,
+    LEXER_ACTION_STRING,
+    LEXER_ACTION_QUOTE,
+    LEXER_ACTION_WHITESPACE,
+    LEXER_ACTION_NEWLINE,
+    LEXER_ACTION_LINE_COMMENT,
+    LEXER_ACTION_BLOCK_COMMENT,
+    LEXER_ACTION_COUNT
+} lexer_action_e;
+
+#define LEXER_ACTION(action) (LEXER_STATE_COUNT + (action))
+
+enum
+{
+    // Read the input file through stdio a window at a time instead of
+    // mapping the whole source into memory.
+    COMPILE_PROCESS_FLAG_STDIO_INPUT = 0b00000001
+};
+
 typedef struct _compile_process_input_file_s
 {
     FILE *fp;
     const char *abs_path;
+
+    // The whole source as one contiguous span of bytes.
+    // NULL when the file is read with COMPILE_PROCESS_FLAG_STDIO_INPUT.
+    const char *data;
+    size_t size;
+    bool mapped; ///< True if data is mmaped, false if it was read into the heap
+    size_t capacity; ///< Bytes allocated for data when it was read into the heap
+
+    // The last LEX_PROCESS_WINDOW_SIZE or less bytes read from fp with
+    // COMPILE_PROCESS_FLAG_STDIO_INPUT, window[0] is at window_offset
+    char *window;
+    size_t window_offset;
+    size_t window_size;
+
+    // Bytes of the file read or mapped so far
+    size_t bytes_read;
 } compile_process_input_file_s;
 
+typedef enum _compile_phase_e
+{
+    COMPILE_PHASE_READ,
+    COMPILE_PHASE_LEX,
+    COMPILE_PHASE_PARSE,
+    COMPILE_PHASE_CODEGEN,
+    COMPILE_PHASE_COUNT
+} compile_phase_e;
+
+typedef struct _compile_phase_time_s
+{
+    double wall; ///< Seconds
+    double cpu;  ///< Seconds of CPU time of the compiling thread
+} compile_phase_time_s;
+
+typedef struct _compile_stats_s
+{
+    // Lexing done on other threads of a pool only shows in the wall time
+    compile_phase_time_s phases[COMPILE_PHASE_COUNT];
+    size_t bytes_read;
+    bool token_cache_hit;
+    size_t tokens[TOKEN_TYPE_COUNT];
+
+    // What the helpers allocated for this compile, on any thread
+    struct helper_stats helpers;
+
+    // The intern pool of the compile once it is done. Chunks lexed in
+    // parallel intern into pools of their own, only their merge shows here.
+    struct intern_stats interns;
+} compile_stats_s;
+
+typedef enum _diagnostic_severity_e
+{
+    DIAGNOSTIC_ERROR,
+    DIAGNOSTIC_WARNING
+} diagnostic_severity_e;
+
+typedef struct _diagnostic_s
+{
+    diagnostic_severity_e severity;
+    pos_s pos;           ///< Where the compiler was, lines and columns count from zero
+    const char *message; ///< Without the trailing newline, lives in the text of the collector
+} diagnostic_s;
+
+// Diagnostics and bytes of text a collector holds unless told otherwise
+#define DIAGNOSTICS_DEFAULT_CAPACITY 256
+#define DIAGNOSTICS_DEFAULT_TEXT_SIZE (64 * 1024)
+
+/**
+ * @brief Collects the errors and warnings of a compile so the caller can go
+ * through them once it is done.
+ *
+ * All memory is allocated up front, reporting never allocates. Diagnostics
+ * past what fits are still counted in errors and warnings but not kept.
+ */
+typedef struct _diagnostics_s
+{
+    diagnostic_s *entries;
+    size_t capacity;
+    size_t count;
+
+    // Messages and file names of the entries
+    char *text;
+    size_t text_size;
+    size_t text_used;
+
+    size_t errors;
+    size_t warnings;
+    size_t dropped; ///< Diagnostics that didn't fit
+} diagnostics_s;
+
 typedef struct _compile_process_s
 {
     int flags; ///< The flags in regrads to how this file should be compiled
@@ -131,12 +407,90 @@ typedef struct _compile_process_s
     compile_process_input_file_s cfile;
     vector_s *token_vec; ///< A vector of tokens from lexical analysis
     FILE *ofp;
+
+    // Deduplicates identifier, keyword and string lexemes of this compile
+    intern_pool_s *interns;
+    bool shared_interns; ///< interns belongs to the caller, it outlives the process
+
+    // Errors and warnings are collected here instead of printed when set,
+    // so a driver can report files compiled in parallel in a stable order.
+    diagnostics_s *diagnostics;
+    size_t warnings; ///< Warnings reported so far, collected or printed
+
+    // When set compile_error and compile_warning jump here instead of
+    // reporting anything. Used to lex chunks speculatively, where an error
+    // may only mean the chunk was lexed from the wrong starting state.
+    jmp_buf *error_jmp;
+
+    // compile_error reports the error and unwinds to here. lex sets it to
+    // resync and go on past the error, compile_file_with_options to fail
+    // the file. Without it an error exits the process.
+    jmp_buf *failure_jmp;
+
+    // Filled in as the file is compiled, NULL unless asked for
+    compile_stats_s *stats;
+
+    // Where this process and the lex processes of it get their memory
+    allocator_s *allocator;
 } compile_process_s;
 
+typedef struct _compile_options_s
+{
+    int flags;
+
+    // Errors and warnings are collected here when set instead of being printed
+    diagnostics_s *diagnostics;
+
+    // Large files are lexed in parallel on this pool when set
+    threadpool_s *pool;
+
+    // Tokens of sources that were lexed before are loaded from here when set
+    token_cache_s *token_cache;
+
+    // Per phase timings and counters are collected here when set
+    compile_stats_s *stats;
+
+    // The compile runs on memory from here when set, see helpers/allocator.h
+    allocator_s *allocator;
+
+    // Lexemes are interned here instead of a pool of the compile when set,
+    // the pool stays warm from one compile to the next
+    intern_pool_s *interns;
+} compile_options_s;
+
 typedef struct _lex_process_s lex_process_s;
 
+// Rough amount of source bytes per token in typical C, used to pre-size token vectors
+#define LEX_PROCESS_BYTES_PER_TOKEN 4
+
+typedef struct _lex_brackets_s
+{
+    unsigned int start; ///< Offset right after the opening '('
+    unsigned int end;   ///< Offset of the closing ')', 0 while it is still open
+} lex_brackets_s;
+
+// Bytes read at once from inputs that aren't contiguous in memory
+#define LEX_PROCESS_WINDOW_SIZE 65536
+
+// Tokens lex_next keeps lexed ahead, lex_peek sees up to two less than this
+#define LEX_PROCESS_LOOKAHEAD 8
+
 typedef struct _lex_process_functions_s
 {
+    // Hands the lexer the input from offset on as one contiguous span and
+    // sets size to its length, zero at the end of the input. The span stays
+    // valid until the next call. The lexer asks for the offsets in order and
+    // only once it has read everything before them.
+    const char *(*fill)(lex_process_s *process, size_t offset, size_t *size);
+
+    // Optional, returns the whole input as one contiguous span or NULL if the
+    // input isn't available that way. Tokens are then sliced out of it and
+    // the lexer reads it directly without calling fill.
+    const char *(*source)(lex_process_s *process, size_t *size);
+
+    // The character at a time interface from before fill. Inputs without
+    // fill are read through an adapter on top of next_char and peek_char,
+    // push_char is never called.
     char (*next_char)(lex_process_s *process);
     char (*peek_char)(lex_process_s *process);
     void (*push_char)(lex_process_s *process, char c);
@@ -149,30 +503,267 @@ typedef struct _lex_process_s
     compile_process_s *compiler;
 
     int current_expression_count;
-    buffer_s *parentheses_buffer;
+    // Vector of lex_brackets_s, every outermost pair of parentheses in the input
+    vector_s *brackets;
     lex_process_functions_s *function;
 
+    // The contiguous input returned by lex_process_functions_s::source, or NULL
+    const char *source;
+    size_t source_size;
+    size_t offset;      ///< Characters consumed so far, the offset into source
+    size_t token_start; ///< Offset of the first character of the current token
+    char token_first;   ///< The first character of the current token, EOF at the end
+
+    // The span of input the lexer reads from, window[0] is the character at
+    // window_offset. It is the whole source when there is one.
+    const char *window;
+    size_t window_offset;
+    size_t window_size;
+    char window_previous; ///< The character right before window, for lexer_unread
+    // Characters read ahead through next_char for inputs without fill
+    char *adapter_window;
+
+    // Scratch storage of the lexer, token text that isn't interned lives
+    // here and is released all at once by lex_process_free.
+    arena_s *arena;
+
+    // The allocator of the compiler, everything above comes from it
+    allocator_s *allocator;
+
+    // Set by lexers that start in the middle of a file and can't know the
+    // parenthesis depth. between_brackets and brackets are then left empty
+    // for the caller to compute, see lex_parallel.
+    bool defer_brackets;
+
+    // The token being built, it is copied into the lookahead once complete.
+    // All lexer state lives in the lex process so any number of them can
+    // run at once, nested or on different threads.
+    token_s token;
+
+    // Tokens lexed but not yet handed out by lex_next, lookahead_count of
+    // them starting at lookahead_head. The newest one is the last token the
+    // lexer may still change, whitespace after it sets its flag.
+    token_s lookahead[LEX_PROCESS_LOOKAHEAD];
+    int lookahead_head;
+    int lookahead_count;
+    bool lookahead_end; ///< The lexer reached the end of the input
+
     // This willl be private data that the lexer does not understand,
     // but the person using the lexer does understand.
     void *private;
 } lex_process_s;
 
 int compile_file(const char *filename, const char *out_filename, int flags);
+
+/**
+ * @brief Same as compile_file with the extra options a driver needs.
+ *
+ * @param filename
+ * @param out_filename
+ * @param options
+ * @return int compiler_result_e
+ */
+int compile_file_with_options(const char *filename, const char *out_filename, compile_options_s *options);
 compile_process_s *compile_process_create(const char *filename, const char *filename_out, int flags);
 
-char compile_process_next_char(lex_process_s *lex_process);
-char compile_process_peek_char(lex_process_s *lex_process);
-void compile_process_push_char(lex_process_s *lex_process, char c);
+/**
+ * @brief Same as compile_process_create with all memory coming from the
+ * given allocator, the mapped source excepted.
+ *
+ * @param filename
+ * @param filename_out
+ * @param flags
+ * @param allocator Has to outlive the process, NULL for the libc allocator
+ * @return compile_process_s*
+ */
+compile_process_s *compile_process_create_allocator(const char *filename, const char *filename_out, int flags, allocator_s *allocator);
+
+/**
+ * @brief Same as compile_process_create with the flags, allocator and intern
+ * pool of the options.
+ *
+ * @param filename
+ * @param filename_out
+ * @param options
+ * @return compile_process_s*
+ */
+compile_process_s *compile_process_create_options(const char *filename, const char *filename_out, compile_options_s *options);
+
+/**
+ * @brief Creates a process with no source or output of its own. It lends its
+ * intern pool, allocator and flags to lexers of strings and buffers, as
+ * tokens_build_for_string does.
+ *
+ * @param options
+ * @return compile_process_s*
+ */
+compile_process_s *compile_process_create_without_file(compile_options_s *options);
+void compile_process_free(compile_process_s *process);
+
+/**
+ * @brief Returns the whole source of the input file as a contiguous span.
+ *
+ * @param process
+ * @param size Set to the number of bytes in the span
+ * @return const char* NULL if the input is read through stdio
+ */
+const char *compile_process_source(compile_process_s *process, size_t *size);
+
+/**
+ * @brief Streams a buffer to the output file, rope buffers go out chunk by
+ * chunk through writev without being joined first.
+ *
+ * @param process
+ * @param buffer
+ * @return int 0 on success, -1 if there is no output file or the write failed
+ */
+int compile_process_write_output(compile_process_s *process, buffer_s *buffer);
+
+const char *compile_process_fill(lex_process_s *lex_process, size_t offset, size_t *size);
+const char *compile_process_lex_source(lex_process_s *lex_process, size_t *size);
 
 void compile_error(compile_process_s *compiler, const char *msg, ...);
 void compile_warning(compile_process_s *compiler, const char *msg, ...);
 
+/**
+ * @brief Creates an empty collector with room for the given amount of diagnostics.
+ *
+ * @param capacity Diagnostics kept at most
+ * @param text_size Bytes their messages may take in total
+ * @return diagnostics_s*
+ */
+diagnostics_s *diagnostics_create(size_t capacity, size_t text_size);
+void diagnostics_free(diagnostics_s *diagnostics);
+
+/**
+ * @brief Forgets every diagnostic and count, the memory is kept.
+ *
+ * @param diagnostics
+ */
+void diagnostics_clear(diagnostics_s *diagnostics);
+void diagnostics_add(diagnostics_s *diagnostics, diagnostic_severity_e severity, pos_s pos, const char *msg, va_list args);
+
+/**
+ * @brief Adds the diagnostic to the collector, or prints it to stderr when
+ * there is none.
+ *
+ * @param diagnostics May be NULL
+ */
+void diagnostics_report(diagnostics_s *diagnostics, diagnostic_severity_e severity, pos_s pos, const char *msg, va_list args);
+size_t diagnostics_count(diagnostics_s *diagnostics);
+diagnostic_s *diagnostics_at(diagnostics_s *diagnostics, size_t index);
+
+/**
+ * @brief Writes the diagnostics in the order they were reported, one per line,
+ * followed by a note of how many didn't fit.
+ *
+ * @param diagnostics
+ * @param buffer
+ */
+void diagnostics_write(diagnostics_s *diagnostics, buffer_s *buffer);
+void diagnostics_print(diagnostics_s *diagnostics, FILE *fp);
+
 lex_process_s *lex_process_create(compile_process_s *compiler, lex_process_functions_s *functions, void *private);
 void lex_process_free(lex_process_s *process);
 void *lex_process_private(lex_process_s *process);
+
+/**
+ * @brief Asks the input of the process for the span at offset, through
+ * lex_process_functions_s::fill or the next_char adapter when it has none.
+ *
+ * @param process
+ * @param offset
+ * @param size Set to the length of the span, zero at the end of the input
+ * @return const char*
+ */
+const char *lex_process_fill(lex_process_s *process, size_t offset, size_t *size);
 vector_s *lex_process_tokens(lex_process_s *process);
+
+/**
+ * @brief Returns the text of a token, whether it owns it in sval or only has a slice of the source.
+ *
+ * @param process The lex process that created the token
+ * @param token
+ * @param len Set to the length of the text
+ * @return const char* Not NULL terminated for slices, NULL if the token has no text
+ */
+const char *lex_process_token_text(lex_process_s *process, token_s *token, size_t *len);
+
+/**
+ * @brief Returns the source between the outermost parentheses the token is in.
+ *
+ * @param process The lex process that created the token
+ * @param token
+ * @param len Set to the length of the text
+ * @return const char* NULL if the token isn't in parentheses or the source isn't contiguous
+ */
+const char *lex_process_between_brackets(lex_process_s *process, token_s *token, size_t *len);
+
+/**
+ * @brief Lexes the whole input into token_vec. A bad token is reported and
+ * skipped, lexing goes on to report the errors after it as well.
+ *
+ * @param process
+ * @return int LEXICAL_ANALYSIS_INPUT_ERROR if anything was reported as an error
+ */
 int lex(lex_process_s *process);
 
+/**
+ * @brief Prepares the process to lex from the given offset of its input.
+ * The offset must be the start of a token or of whitespace before one.
+ *
+ * @param process
+ * @param offset
+ */
+void lex_start(lex_process_s *process, size_t offset);
+
+/**
+ * @brief Lexes the next token on demand, without adding it to the token vector.
+ * Only a few tokens of lookahead are held, so a caller that consumes tokens
+ * as they come needs no memory for the rest of the file. Errors unwind to
+ * compile_process_s::failure_jmp of the caller.
+ *
+ * @param process Started with lex_start
+ * @return token_s* Valid until the next lex_next or lex_peek, NULL at the end of the input
+ */
+token_s *lex_next(lex_process_s *process);
+
+/**
+ * @brief Returns the token lex_next returns k calls from now without consuming it.
+ *
+ * @param process Started with lex_start
+ * @param k Below LEX_PROCESS_LOOKAHEAD - 1, 0 is the next token
+ * @return token_s* Valid until the next lex_next or lex_peek, NULL past the end of the input
+ */
+token_s *lex_peek(lex_process_s *process, int k);
+
+/**
+ * @brief Lexes the contiguous source of the process in chunks on the given
+ * pool and stitches them into token_vec. The tokens are the same as lex()
+ * produces, small or non contiguous inputs are simply handed to lex(), as
+ * are inputs with errors so they are reported in order.
+ *
+ * @param process
+ * @param pool
+ * @return int lex_result_e
+ */
+int lex_parallel(lex_process_s *process, threadpool_s *pool);
+
+/**
+ * @brief Brings the tokens of a lexed process up to date after its source was edited.
+ * Only the lines from the one before the edit up to the first newline after it
+ * where the old and new tokens agree again are lexed and spliced into token_vec.
+ * The tokens after them are only moved when the edit changes the size or lines.
+ * An edit that leaves an error behind is lexed again in full by lex().
+ *
+ * @param process A lex process that lexed the old source and now reads the new one
+ * @param offset Where the edit starts
+ * @param removed Bytes of the old source the edit replaced
+ * @param inserted Bytes the new source has in their place
+ * @return int lex_result_e
+ */
+int lex_incremental(lex_process_s *process, size_t offset, size_t removed, size_t inserted);
+
 /**
  * @brief Builds tokens for the input string.
  *
@@ -183,5 +774,301 @@ int lex(lex_process_s *process);
 lex_process_s *tokens_build_for_string(compile_process_s *compiler, const char *str);
 
 bool token_is_keyword(token_s *token, const char *value);
+bool token_is_keyword_id(token_s *token, keyword_e keyword);
+const char *token_type_name(token_type_e type);
+
+// Layout of the per token type byte in token_store_s
+#define TOKEN_STORE_TYPE_MASK 0x07
+#define TOKEN_STORE_WHITESPACE 0x08
+#define TOKEN_STORE_NUMBER_TYPE_SHIFT 4
+#define TOKEN_STORE_NUMBER_TYPE_MASK 0x30
+#define TOKEN_STORE_WIDE_NUMBER 0x40 ///< The payload indexes wide_numbers, numbers with suffix flags are always wide
+#define TOKEN_STORE_SOURCE_SLICE 0x80 ///< Comment text is payload bytes at the offset
+
+typedef struct _token_store_file_s
+{
+    const char *filename;
+
+    // The source the offsets point into, may be NULL if it wasn't contiguous
+    const char *source;
+
+    // Sorted vector of token_store_line_s, one for every line a token ends on.
+    // Lines without any token are left out since no token starts on them either.
+    vector_s *lines;
+} token_store_file_s;
+
+typedef struct _token_store_line_s
+{
+    unsigned int offset; ///< Offset of the first character of the line
+    int line;
+} token_store_line_s;
+
+typedef struct _token_store_number_s
+{
+    unsigned long long value; ///< llnum, or the bits of dnum
+    int flags;                ///< TOKEN_FLAG_NUMBER_* flags of the number
+} token_store_number_s;
+
+/**
+ * @brief A compact, struct of arrays store of tokens.
+ *
+ * Every token costs 11 bytes spread over parallel arrays, sequential scans over
+ * one property only touch that array. Line and column are derived from the
+ * offset through the line table of the token's file.
+ */
+typedef struct _token_store_s
+{
+    size_t count;
+    size_t capacity;
+
+    unsigned char *types;     ///< token_type_e and TOKEN_STORE_* flags
+    unsigned int *offsets;    ///< Offset of the first character of the token in its file
+    unsigned int *payloads;   ///< Intern id, keyword_e, operator_e, symbol character or number
+    unsigned short *file_ids; ///< Index into files
+
+    vector_s *files;        ///< Vector of token_store_file_s
+    vector_s *wide_numbers; ///< Vector of token_store_number_s that don't fit in a payload
+    intern_pool_s *interns; ///< Resolves the intern ids of identifiers and strings
+} token_store_s;
+
+token_store_s *token_store_create(intern_pool_s *interns);
+void token_store_free(token_store_s *store);
+
+/**
+ * @brief Appends every token of the given lex process to the store as a new file.
+ *
+ * @param store
+ * @param lex_process A lex process that finished lexing, its interns must be the store's
+ * @return int The file id the tokens were stored under
+ */
+int token_store_append(token_store_s *store, lex_process_s *lex_process);
+
+static inline size_t token_store_count(token_store_s *store)
+{
+    return store->count;
+}
+
+static inline token_type_e token_store_type(token_store_s *store, size_t index)
+{
+    return store->types[index] & TOKEN_STORE_TYPE_MASK;
+}
+
+static inline bool token_store_whitespace(token_store_s *store, size_t index)
+{
+    return store->types[index] & TOKEN_STORE_WHITESPACE;
+}
+
+static inline unsigned int token_store_payload(token_store_s *store, size_t index)
+{
+    return store->payloads[index];
+}
+
+static inline bool token_store_is_keyword(token_store_s *store, size_t index, keyword_e keyword)
+{
+    return token_store_type(store, index) == TOKEN_TYPE_KEYWORD && store->payloads[index] == keyword;
+}
+
+static inline bool token_store_is_operator(token_store_s *store, size_t index, operator_e op)
+{
+    return token_store_type(store, index) == TOKEN_TYPE_OPERATOR && store->payloads[index] == op;
+}
+
+const char *token_store_text(token_store_s *store, size_t index, size_t *len);
+unsigned long long token_store_number(token_store_s *store, size_t index);
+
+/**
+ * @brief Returns where the token starts, unlike token_s::pos which is where it ends.
+ */
+pos_s token_store_pos(token_store_s *store, size_t index);
+
+/**
+ * @brief Expands the token at index back into a token_s, between_brackets isn't kept.
+ */
+void token_store_get(token_store_s *store, size_t index, token_s *token);
+
+/**
+ * @brief Returns the bytes the store holds for its tokens, line tables included.
+ */
+size_t token_store_memory_usage(token_store_s *store);
+
+/**
+ * @brief Finds the keyword id of the given identifier with a perfect hash.
+ *
+ * @param str The identifier, doesn't need to be NULL terminated
+ * @param len The length of the identifier
+ * @return keyword_e KEYWORD_NONE if this isn't a keyword
+ */
+keyword_e keyword_lookup(const char *str, size_t len);
+const char *keyword_name(keyword_e keyword);
+
+/**
+ * @brief Steps the operator DFA, start in OPERATOR_NONE with the first character.
+ *
+ * @param state The current state
+ * @param c The next character
+ * @return int The next state, OPERATOR_NONE if no longer operator can be formed
+ */
+int operator_transition(int state, char c);
+bool operator_state_is_accepting(int state);
+
+/**
+ * @brief The operator a walk that stopped in a state that isn't accepting
+ * backs off to, like C's maximal munch reads ".." as two "." operators.
+ *
+ * @param state The state the walk stopped in
+ * @param give_back Set to how many of the characters read belong to the next token
+ * @return operator_e OPERATOR_NONE if there is none
+ */
+operator_e operator_state_fallback(int state, size_t *give_back);
+const char *operator_name(operator_e op);
+
+typedef enum _scan_isa_e
+{
+    SCAN_ISA_SCALAR,
+    SCAN_ISA_SSE2,
+    SCAN_ISA_AVX2
+} scan_isa_e;
+
+/**
+ * @brief Returns the length of the run of identifier characters [A-Za-z0-9_]
+ * at the start of data. The scanners below work on the contiguous source a
+ * block of bytes at a time with the widest instructions the CPU has.
+ *
+ * @param data
+ * @param size Bytes available at data, nothing past them is read
+ * @return size_t
+ */
+size_t scan_identifier(const char *data, size_t size);
+size_t scan_digits(const char *data, size_t size);
+// Spaces and tabs, newlines are tokens of their own
+size_t scan_whitespace(const char *data, size_t size);
+// Returns the offset of the next '\n', size if there is none
+size_t scan_line_comment(const char *data, size_t size);
+// Returns the offset of the next "*/", size if there is none
+size_t scan_block_comment(const char *data, size_t size);
+
+/**
+ * @brief Switches every scanner to the given instruction set, the best one
+ * the CPU supports is selected at startup.
+ *
+ * @param isa
+ * @return bool false if the CPU doesn't support it, the selection is then unchanged
+ */
+bool scan_select(scan_isa_e isa);
+bool scan_isa_supported(scan_isa_e isa);
+scan_isa_e scan_best_isa();
+const char *scan_isa_name(scan_isa_e isa);
+
+typedef struct _token_cache_stats_s
+{
+    size_t hits;
+    size_t misses;
+    size_t stores;
+    size_t evictions;   ///< Files removed to stay within the size bound
+    size_t bytes_loaded;
+} token_cache_stats_s;
+
+/**
+ * @brief Opens a directory of lexed sources, it is created if it doesn't exist.
+ * The files are keyed by a hash of the source and the compile flags, one
+ * cache may be shared by every thread of a driver.
+ *
+ * @param directory
+ * @param max_size Bytes the directory may hold, the least recently used files
+ * are removed past it. 0 for no bound.
+ * @return token_cache_s* NULL if the directory can't be created
+ */
+token_cache_s *token_cache_create(const char *directory, size_t max_size);
+void token_cache_free(token_cache_s *cache);
+
+/**
+ * @brief Fills the tokens and brackets of the process from the cache as if it
+ * had lexed its source. Only contiguous sources are cached. The file is mapped
+ * and its fixed size records are copied into token_vec, nothing is parsed.
+ *
+ * @param cache
+ * @param process A lex process that didn't lex yet
+ * @param flags The compile flags the tokens were stored with
+ * @return bool false on a miss, the process is left untouched
+ */
+bool token_cache_load(token_cache_s *cache, lex_process_s *process, int flags);
+
+/**
+ * @brief Writes the tokens of a lex process that lexed its source without errors
+ * or warnings, the warnings of a file would not be reported on a hit.
+ *
+ * @param cache
+ * @param process
+ * @param flags
+ */
+void token_cache_store(token_cache_s *cache, lex_process_s *process, int flags);
+void token_cache_stats(token_cache_s *cache, token_cache_stats_s *stats);
+void token_cache_print_stats(token_cache_s *cache, FILE *fp);
+
+/**
+ * @brief Reads the clocks a phase is timed with.
+ *
+ * @param now
+ */
+void compile_stats_clock(compile_phase_time_s *now);
+
+/**
+ * @brief Adds the time since start to a phase and restarts the clock, does
+ * nothing without stats.
+ *
+ * @param stats May be NULL
+ * @param phase
+ * @param start
+ */
+void compile_stats_end_phase(compile_stats_s *stats, compile_phase_e phase, compile_phase_time_s *start);
+void compile_stats_count_tokens(compile_stats_s *stats, vector_s *token_vec);
+
+/**
+ * @brief Writes the stats as one line of JSON.
+ *
+ * @param stats
+ * @param filename The file the stats are of
+ * @param fp
+ */
+void compile_stats_print_json(compile_stats_s *stats, const char *filename, FILE *fp);
+uint64_t token_cache_hash(const char *data, size_t size, uint64_t seed);
+
+// Requests of a compile server are lines of text, "compile file.c [output]"
+// or "shutdown". Every compile gets a "ok <length>" or "failed <length>"
+// line back followed by that many bytes of diagnostics, a request the server
+// doesn't understand gets "error <length>" and a message.
+#define COMPILE_SERVER_MAX_REQUEST 4096
+
+/**
+ * @brief Creates a compiler that stays up and compiles one request after
+ * another, keeping its memory, intern pool, threads and caches warm between them.
+ *
+ * @param options Flags, pool and token cache of every compile. The rest is
+ * provided by the server.
+ * @return compile_server_s*
+ */
+compile_server_s *compile_server_create(compile_options_s *options);
+void compile_server_free(compile_server_s *server);
+
+/**
+ * @brief Answers the requests read from in on out until the end of in or a
+ * shutdown request. A compile that fails only fails its request.
+ *
+ * @param server
+ * @param in
+ * @param out
+ * @return bool true if a shutdown was requested
+ */
+bool compile_server_serve(compile_server_s *server, FILE *in, FILE *out);
+
+/**
+ * @brief Serves the connections to a Unix socket one after another until one
+ * of them requests a shutdown. The socket file is replaced if it exists.
+ *
+ * @param server
+ * @param socket_path
+ * @return int 0 after a shutdown, -1 if the socket couldn't be set up
+ */
+int compile_server_listen(compile_server_s *server, const char *socket_path);
 
 #endif // !__CCOMPILER_H__
@@ -1,57 +1,311 @@
-
 #include "compiler.h"
+#include "helpers/intern.h"
+#include "helpers/buffer.h"
+#include "helpers/allocator.h"
 #include <stdio.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <limits.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Read size used when the input can't be mapped (pipes, character devices)
+#define COMPILE_PROCESS_READ_CHUNK 65536
+
+static bool compile_process_map_source(compile_process_input_file_s *cfile)
+{
+    int fd = fileno(cfile->fp);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+    {
+        return false;
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (MAP_FAILED == data)
+    {
+        return false;
+    }
+
+    // The lexer walks the source front to back exactly once
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    cfile->data = data;
+    cfile->size = st.st_size;
+    cfile->bytes_read = st.st_size;
+    cfile->mapped = true;
+    return true;
+}
+
+static bool compile_process_read_source(compile_process_input_file_s *cfile, allocator_s *allocator)
+{
+    size_t size = 0;
+    size_t capacity = COMPILE_PROCESS_READ_CHUNK;
+    char *data = allocator_alloc(allocator, capacity);
+    if (NULL == data)
+    {
+        return false;
+    }
+
+    size_t read_amount = 0;
+    while ((read_amount = fread(data + size, 1, capacity - size, cfile->fp)) > 0)
+    {
+        size += read_amount;
+        if (size == capacity)
+        {
+            char *new_data = allocator_realloc(allocator, data, capacity, capacity * 2);
+            if (NULL == new_data)
+            {
+                allocator_free(allocator, data, capacity);
+                return false;
+            }
+            capacity *= 2;
+            data = new_data;
+        }
+    }
+
+    if (ferror(cfile->fp))
+    {
+        allocator_free(allocator, data, capacity);
+        return false;
+    }
+
+    cfile->data = data;
+    cfile->size = size;
+    cfile->capacity = capacity;
+    cfile->bytes_read = size;
+    cfile->mapped = false;
+    return true;
+}
+
+static bool compile_process_load_source(compile_process_input_file_s *cfile, allocator_s *allocator)
+{
+    if (compile_process_map_source(cfile))
+    {
+        return true;
+    }
+
+    // Fallback for inputs that can't be mapped, read everything in one go
+    return compile_process_read_source(cfile, allocator);
+}
+
+// Diagnostics and tokens name the file by its absolute path, or by the
+// name it was given when it has none. NULL when the allocator fails.
+static const char *compile_process_abs_path(const char *filename, allocator_s *allocator)
+{
+    char resolved[PATH_MAX];
+    const char *path = realpath(filename, resolved) ? resolved : filename;
+    size_t size = strlen(path) + 1;
+    char *abs_path = allocator_alloc(allocator, size);
+    if (NULL == abs_path)
+    {
+        return NULL;
+    }
+    memcpy(abs_path, path, size);
+    return abs_path;
+}
+
+// A file that fails before there is a process to report through
+static void compile_process_error(compile_options_s *options, const char *filename, const char *msg, ...)
+{
+    pos_s pos = {.filename = filename};
+    va_list args;
+    va_start(args, msg);
+    diagnostics_report(options->diagnostics, DIAGNOSTIC_ERROR, pos, msg, args);
+    va_end(args);
+}
 
 compile_process_s *compile_process_create(const char *filename, const char *filename_out, int flags)
+{
+    return compile_process_create_allocator(filename, filename_out, flags, NULL);
+}
+
+compile_process_s *compile_process_create_allocator(const char *filename, const char *filename_out, int flags, allocator_s *allocator)
+{
+    compile_options_s options = {.flags = flags, .allocator = allocator};
+    return compile_process_create_options(filename, filename_out, &options);
+}
+
+compile_process_s *compile_process_create_without_file(compile_options_s *options)
+{
+    allocator_s *allocator = allocator_or_default(options->allocator);
+    compile_process_s *process = allocator_calloc(allocator, sizeof(compile_process_s));
+    if (NULL == process)
+    {
+        return NULL;
+    }
+    process->allocator = allocator;
+    process->flags = options->flags;
+    process->shared_interns = options->interns != NULL;
+    process->interns = options->interns ? options->interns : intern_pool_create_allocator(allocator);
+    return process;
+}
+
+compile_process_s *compile_process_create_options(const char *filename, const char *filename_out, compile_options_s *options)
 {
     FILE *fp = fopen(filename, "r");
     if (NULL == fp)
     {
+        compile_process_error(options, filename, "Could not open the file: %s", strerror(errno));
         return NULL;
     }
 
     FILE *fp_out = NULL;
     if (filename_out != NULL)
     {
+        // Opening the output would empty the source before it is read
+        struct stat st_in;
+        struct stat st_out;
+        if (fstat(fileno(fp), &st_in) == 0 && stat(filename_out, &st_out) == 0 &&
+            st_in.st_dev == st_out.st_dev && st_in.st_ino == st_out.st_ino)
+        {
+            compile_process_error(options, filename, "The output %s is the input file", filename_out);
+            fclose(fp);
+            return NULL;
+        }
+
         fp_out = fopen(filename_out, "w");
         if (NULL == fp_out)
         {
+            compile_process_error(options, filename, "Could not open the output %s: %s", filename_out, strerror(errno));
+            fclose(fp);
             return NULL;
         }
     }
 
-    compile_process_s *process = calloc(1, sizeof(compile_process_s));
-    process->flags = flags;
+    compile_process_s *process = compile_process_create_without_file(options);
+    if (NULL == process)
+    {
+        compile_process_error(options, filename, "Out of memory");
+        if (fp_out)
+        {
+            fclose(fp_out);
+        }
+        fclose(fp);
+        return NULL;
+    }
+
+    allocator_s *allocator = process->allocator;
     process->cfile.fp = fp;
+    process->cfile.abs_path = compile_process_abs_path(filename, allocator);
+    process->pos.filename = process->cfile.abs_path;
     process->ofp = fp_out;
+    if (NULL == process->cfile.abs_path)
+    {
+        compile_process_error(options, filename, "Out of memory");
+        compile_process_free(process);
+        return NULL;
+    }
+
+    if (process->flags & COMPILE_PROCESS_FLAG_STDIO_INPUT)
+    {
+        process->cfile.window = allocator_alloc(allocator, LEX_PROCESS_WINDOW_SIZE);
+        if (NULL == process->cfile.window)
+        {
+            compile_process_error(options, filename, "Out of memory");
+            compile_process_free(process);
+            return NULL;
+        }
+    }
+    else if (!compile_process_load_source(&process->cfile, allocator))
+    {
+        compile_process_error(options, filename, "Could not read the file");
+        compile_process_free(process);
+        return NULL;
+    }
+
     return process;
 }
 
-char compile_process_next_char(lex_process_s *lex_process)
+void compile_process_free(compile_process_s *process)
 {
-    compile_process_s *compiler = lex_process->compiler;
-    compiler->pos.col += 1;
-    char c = getc(compiler->cfile.fp);
-    if (c == '\n')
+    allocator_s *allocator = process->allocator;
+    compile_process_input_file_s *cfile = &process->cfile;
+    if (cfile->mapped)
     {
-        compiler->pos.line += 1;
-        compiler->pos.col = 0;
+        munmap((void *)cfile->data, cfile->size);
+    }
+    else if (cfile->data)
+    {
+        allocator_free(allocator, (void *)cfile->data, cfile->capacity);
+    }
+    if (cfile->window)
+    {
+        allocator_free(allocator, cfile->window, LEX_PROCESS_WINDOW_SIZE);
     }
 
-    return c;
+    // Processes without a file have none of these
+    if (cfile->abs_path)
+    {
+        allocator_free(allocator, (void *)cfile->abs_path, strlen(cfile->abs_path) + 1);
+    }
+    if (cfile->fp)
+    {
+        fclose(cfile->fp);
+    }
+    if (!process->shared_interns)
+    {
+        intern_pool_free(process->interns);
+    }
+    if (process->ofp)
+    {
+        fclose(process->ofp);
+    }
+    allocator_free(allocator, process, sizeof(compile_process_s));
 }
 
-char compile_process_peek_char(lex_process_s *lex_process)
+const char *compile_process_source(compile_process_s *process, size_t *size)
 {
-    compile_process_s *compiler = lex_process->compiler;
-    char c = getc(compiler->cfile.fp);
-    ungetc(c, compiler->cfile.fp);
-    return c;
+    *size = process->cfile.size;
+    return process->cfile.data;
+}
+
+int compile_process_write_output(compile_process_s *process, buffer_s *buffer)
+{
+    if (NULL == process->ofp)
+    {
+        return -1;
+    }
+
+    return buffer_writev(buffer, process->ofp);
 }
 
-void compile_process_push_char(lex_process_s *lex_process, char c)
+static bool compile_process_is_stdio_input(compile_process_s *compiler)
+{
+    return compiler->flags & COMPILE_PROCESS_FLAG_STDIO_INPUT;
+}
+
+// Reads the file a window at a time, the lexer only ever moves on to the
+// input right after the current window
+static const char *compile_process_fill_stdio(compile_process_input_file_s *cfile, size_t offset, size_t *size)
+{
+    if (offset >= cfile->window_offset + cfile->window_size)
+    {
+        cfile->window_offset += cfile->window_size;
+        cfile->window_size = fread(cfile->window, 1, LEX_PROCESS_WINDOW_SIZE, cfile->fp);
+        cfile->bytes_read += cfile->window_size;
+    }
+
+    size_t index = offset - cfile->window_offset;
+    *size = index < cfile->window_size ? cfile->window_size - index : 0;
+    return cfile->window + index;
+}
+
+const char *compile_process_fill(lex_process_s *lex_process, size_t offset, size_t *size)
 {
     compile_process_s *compiler = lex_process->compiler;
-    ungetc(c, compiler->cfile.fp);
+    if (compile_process_is_stdio_input(compiler))
+    {
+        return compile_process_fill_stdio(&compiler->cfile, offset, size);
+    }
+
+    compile_process_input_file_s *cfile = &compiler->cfile;
+    *size = offset < cfile->size ? cfile->size - offset : 0;
+    return cfile->data + offset;
+}
+
+const char *compile_process_lex_source(lex_process_s *lex_process, size_t *size)
+{
+    return compile_process_source(lex_process->compiler, size);
 }
@@ -0,0 +1,128 @@
+#include "compiler.h"
+#include "helpers/buffer.h"
+#include <stdarg.h>
+#include <stdlib.h>
+
+diagnostics_s *diagnostics_create(size_t capacity, size_t text_size)
+{
+    diagnostics_s *diagnostics = calloc(1, sizeof(diagnostics_s));
+    diagnostics->entries = calloc(capacity, sizeof(diagnostic_s));
+    diagnostics->capacity = capacity;
+    diagnostics->text = malloc(text_size);
+    diagnostics->text_size = text_size;
+    return diagnostics;
+}
+
+void diagnostics_free(diagnostics_s *diagnostics)
+{
+    free(diagnostics->entries);
+    free(diagnostics->text);
+    free(diagnostics);
+}
+
+void diagnostics_clear(diagnostics_s *diagnostics)
+{
+    diagnostics->count = 0;
+    diagnostics->text_used = 0;
+    diagnostics->errors = 0;
+    diagnostics->warnings = 0;
+    diagnostics->dropped = 0;
+}
+
+// Named in place of the file of a diagnostic without one
+#define DIAGNOSTICS_UNKNOWN_FILE "<unknown>"
+
+// Copies a string into the text of the collector, the caller kept room for it
+static const char *diagnostics_copy(diagnostics_s *diagnostics, const char *str)
+{
+    size_t len = strlen(str) + 1;
+    char *copy = diagnostics->text + diagnostics->text_used;
+    memcpy(copy, str, len);
+    diagnostics->text_used += len;
+    return copy;
+}
+
+void diagnostics_add(diagnostics_s *diagnostics, diagnostic_severity_e severity, pos_s pos, const char *msg, va_list args)
+{
+    if (severity == DIAGNOSTIC_ERROR)
+    {
+        diagnostics->errors++;
+    }
+    else
+    {
+        diagnostics->warnings++;
+    }
+
+    // Room for the file name is kept before the message takes what is left
+    size_t filename_size = pos.filename ? strlen(pos.filename) + 1 : 0;
+    size_t available = diagnostics->text_size - diagnostics->text_used;
+    if (diagnostics->count == diagnostics->capacity || available < filename_size + 2)
+    {
+        diagnostics->dropped++;
+        return;
+    }
+    available -= filename_size;
+
+    // A message too long for what is left is cut short rather than dropped
+    char *message = diagnostics->text + diagnostics->text_used;
+    int len = vsnprintf(message, available, msg, args);
+    size_t used = len < 0 ? 0 : (size_t)len < available ? (size_t)len : available - 1;
+    while (used > 0 && message[used - 1] == '\n')
+    {
+        used--;
+    }
+    message[used] = 0x00;
+    diagnostics->text_used += used + 1;
+
+    diagnostic_s *diagnostic = &diagnostics->entries[diagnostics->count++];
+    diagnostic->severity = severity;
+    diagnostic->message = message;
+    diagnostic->pos = pos;
+    // The file name may not outlive the compile
+    diagnostic->pos.filename = pos.filename ? diagnostics_copy(diagnostics, pos.filename) : DIAGNOSTICS_UNKNOWN_FILE;
+}
+
+void diagnostics_report(diagnostics_s *diagnostics, diagnostic_severity_e severity, pos_s pos, const char *msg, va_list args)
+{
+    if (diagnostics)
+    {
+        diagnostics_add(diagnostics, severity, pos, msg, args);
+        return;
+    }
+
+    vfprintf(stderr, msg, args);
+    fprintf(stderr, " on line %i, col %i in file %s\n", pos.line, pos.col, pos.filename ? pos.filename : DIAGNOSTICS_UNKNOWN_FILE);
+}
+
+size_t diagnostics_count(diagnostics_s *diagnostics)
+{
+    return diagnostics->count;
+}
+
+diagnostic_s *diagnostics_at(diagnostics_s *diagnostics, size_t index)
+{
+    return index < diagnostics->count ? &diagnostics->entries[index] : NULL;
+}
+
+void diagnostics_write(diagnostics_s *diagnostics, buffer_s *buffer)
+{
+    for (size_t i = 0; i < diagnostics->count; i++)
+    {
+        diagnostic_s *diagnostic = &diagnostics->entries[i];
+        buffer_printf(buffer, "%s on line %i, col %i in file %s\n", diagnostic->message, diagnostic->pos.line,
+                      diagnostic->pos.col, diagnostic->pos.filename);
+    }
+
+    if (diagnostics->dropped)
+    {
+        buffer_printf(buffer, "%zu more errors and warnings were not kept\n", diagnostics->dropped);
+    }
+}
+
+void diagnostics_print(diagnostics_s *diagnostics, FILE *fp)
+{
+    buffer_s *buffer = buffer_create();
+    diagnostics_write(diagnostics, buffer);
+    fwrite(buffer_ptr(buffer), 1, buffer_len(buffer), fp);
+    buffer_free(buffer);
+}
@@ -0,0 +1,44 @@
+#include "allocator.h"
+#include <stdlib.h>
+#include <string.h>
+
+static void* allocator_libc_alloc(void* context, size_t size)
+{
+    (void)context;
+    return malloc(size);
+}
+
+static void* allocator_libc_realloc(void* context, void* ptr, size_t old_size, size_t new_size)
+{
+    (void)context;
+    (void)old_size;
+    return realloc(ptr, new_size);
+}
+
+static void allocator_libc_free(void* context, void* ptr, size_t size)
+{
+    (void)context;
+    (void)size;
+    free(ptr);
+}
+
+struct allocator allocator_libc = {
+    .alloc = allocator_libc_alloc,
+    .realloc = allocator_libc_realloc,
+    .free = allocator_libc_free,
+};
+
+void* allocator_calloc(struct allocator* allocator, size_t size)
+{
+    if (allocator == &allocator_libc)
+    {
+        return calloc(size, 1);
+    }
+
+    void* ptr = allocator_alloc(allocator, size);
+    if (ptr)
+    {
+        memset(ptr, 0x00, size);
+    }
+    return ptr;
+}
@@ -0,0 +1,52 @@
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+#include <stddef.h>
+
+/**
+ * Where vectors, buffers, arenas and intern pools get their memory from.
+ * Every call gets the context back and the size of the allocation, so
+ * allocators that don't track sizes themselves can be plugged in as well.
+ * An allocator used while lexing in parallel is called from the threads of
+ * the pool and has to be thread safe.
+ */
+struct allocator
+{
+    void* (*alloc)(void* context, size_t size);
+    void* (*realloc)(void* context, void* ptr, size_t old_size, size_t new_size);
+    void (*free)(void* context, void* ptr, size_t size);
+    void* context;
+};
+
+// malloc, realloc and free, what everything uses unless told otherwise
+extern struct allocator allocator_libc;
+
+/**
+ * Returns allocator, or allocator_libc when it is NULL
+ */
+static inline struct allocator* allocator_or_default(struct allocator* allocator)
+{
+    return allocator ? allocator : &allocator_libc;
+}
+
+static inline void* allocator_alloc(struct allocator* allocator, size_t size)
+{
+    return allocator->alloc(allocator->context, size);
+}
+
+void* allocator_calloc(struct allocator* allocator, size_t size);
+
+static inline void* allocator_realloc(struct allocator* allocator, void* ptr, size_t old_size, size_t new_size)
+{
+    return allocator->realloc(allocator->context, ptr, old_size, new_size);
+}
+
+static inline void allocator_free(struct allocator* allocator, void* ptr, size_t size)
+{
+    if (ptr)
+    {
+        allocator->free(allocator->context, ptr, size);
+    }
+}
+
+#endif
@@ -0,0 +1,143 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+static size_t arena_align(size_t size)
+{
+    return (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+}
+
+static struct arena_block* arena_block_create(struct arena* arena, size_t min_size)
+{
+    size_t size = arena->block_size;
+    if (min_size > size)
+    {
+        size = min_size;
+    }
+
+    struct arena_block* block = allocator_alloc(arena->allocator, sizeof(struct arena_block) + size);
+    assert(block);
+    block->prev = arena->head;
+    block->size = size;
+    block->used = 0;
+    arena->head = block;
+    arena->total_size += size;
+    return block;
+}
+
+struct arena* arena_create(size_t block_size)
+{
+    return arena_create_allocator(block_size, NULL);
+}
+
+struct arena* arena_create_allocator(size_t block_size, struct allocator* allocator)
+{
+    allocator = allocator_or_default(allocator);
+    struct arena* arena = allocator_calloc(allocator, sizeof(struct arena));
+    arena->allocator = allocator;
+    arena->block_size = block_size;
+    arena_block_create(arena, block_size);
+    return arena;
+}
+
+void arena_free(struct arena* arena)
+{
+    struct arena_block* block = arena->head;
+    while (block)
+    {
+        struct arena_block* prev = block->prev;
+        allocator_free(arena->allocator, block, sizeof(struct arena_block) + block->size);
+        block = prev;
+    }
+    allocator_free(arena->allocator, arena, sizeof(struct arena));
+}
+
+void* arena_alloc(struct arena* arena, size_t size)
+{
+    size = arena_align(size);
+    struct arena_block* block = arena->head;
+    if (block->used + size > block->size)
+    {
+        block = arena_block_create(arena, size);
+    }
+
+    void* ptr = block->data + block->used;
+    block->used += size;
+    return ptr;
+}
+
+void* arena_calloc(struct arena* arena, size_t size)
+{
+    void* ptr = arena_alloc(arena, size);
+    memset(ptr, 0x00, size);
+    return ptr;
+}
+
+void* arena_realloc(struct arena* arena, void* ptr, size_t old_size, size_t new_size)
+{
+    if (!ptr)
+    {
+        return arena_alloc(arena, new_size);
+    }
+
+    struct arena_block* block = arena->head;
+    old_size = arena_align(old_size);
+    new_size = arena_align(new_size);
+    if ((char*)ptr + old_size == block->data + block->used && (char*)ptr - block->data + new_size <= block->size)
+    {
+        // Last allocation of the current block, we can just bump it
+        block->used = (char*)ptr - block->data + new_size;
+        return ptr;
+    }
+
+    void* new_ptr = arena_alloc(arena, new_size);
+    memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+    return new_ptr;
+}
+
+struct arena_mark arena_mark(struct arena* arena)
+{
+    return (struct arena_mark){.block = arena->head, .used = arena->head->used};
+}
+
+void arena_rewind(struct arena* arena, struct arena_mark mark)
+{
+    while (arena->head != mark.block)
+    {
+        struct arena_block* prev = arena->head->prev;
+        arena->total_size -= arena->head->size;
+        allocator_free(arena->allocator, arena->head, sizeof(struct arena_block) + arena->head->size);
+        arena->head = prev;
+    }
+
+    arena->head->used = mark.used;
+}
+
+static void* arena_allocator_alloc(void* context, size_t size)
+{
+    return arena_alloc(context, size);
+}
+
+static void* arena_allocator_realloc(void* context, void* ptr, size_t old_size, size_t new_size)
+{
+    return arena_realloc(context, ptr, old_size, new_size);
+}
+
+static void arena_allocator_free(void* context, void* ptr, size_t size)
+{
+    // Arena memory is only given back by arena_rewind or arena_free
+    (void)context;
+    (void)ptr;
+    (void)size;
+}
+
+struct allocator arena_allocator(struct arena* arena)
+{
+    return (struct allocator){
+        .alloc = arena_allocator_alloc,
+        .realloc = arena_allocator_realloc,
+        .free = arena_allocator_free,
+        .context = arena,
+    };
+}
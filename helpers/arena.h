@@ -0,0 +1,79 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "allocator.h"
+
+// Size of every block the arena allocates unless a single allocation needs more
+#define ARENA_DEFAULT_BLOCK_SIZE 65536
+// Every allocation is aligned to this many bytes
+#define ARENA_ALIGNMENT 8
+
+struct arena_block
+{
+    struct arena_block* prev;
+    size_t size;
+    size_t used;
+    char data[];
+};
+
+struct arena
+{
+    // The block we are currently bumping allocations out of
+    struct arena_block* head;
+    size_t block_size;
+
+    // Total bytes of all blocks this arena holds
+    size_t total_size;
+
+    // Where the blocks come from
+    struct allocator* allocator;
+};
+
+/**
+ * A position in the arena, everything allocated after it can be released
+ * in one go with arena_rewind
+ */
+struct arena_mark
+{
+    struct arena_block* block;
+    size_t used;
+};
+
+struct arena* arena_create(size_t block_size);
+
+/**
+ * Creates an arena whose blocks come from the given allocator.
+ * \param allocator Has to outlive the arena, NULL for the libc allocator
+ */
+struct arena* arena_create_allocator(size_t block_size, struct allocator* allocator);
+
+/**
+ * Frees every allocation made from this arena and the arena its self
+ */
+void arena_free(struct arena* arena);
+
+void* arena_alloc(struct arena* arena, size_t size);
+void* arena_calloc(struct arena* arena, size_t size);
+
+/**
+ * Grows an allocation of this arena. The memory is extended in place when ptr
+ * is the last allocation and its block has room, otherwise it is copied.
+ */
+void* arena_realloc(struct arena* arena, void* ptr, size_t old_size, size_t new_size);
+
+struct arena_mark arena_mark(struct arena* arena);
+
+/**
+ * Releases everything allocated since the given mark was taken
+ */
+void arena_rewind(struct arena* arena, struct arena_mark mark);
+
+/**
+ * Returns an allocator that bumps out of the arena. Freeing through it does
+ * nothing, the memory goes when the arena is freed or rewound.
+ */
+struct allocator arena_allocator(struct arena* arena);
+
+#endif
@@ -1,56 +1,188 @@
 #include "buffer.h"
+#include "arena.h"
+#include "stats.h"
+#include "allocator.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
 
 struct buffer* buffer_create()
 {
-    struct buffer* buf = calloc(sizeof(struct buffer), 1);
-    buf->data = calloc(BUFFER_REALLOC_AMOUNT, 1);
+    return buffer_create_allocator(NULL);
+}
+
+struct buffer* buffer_create_allocator(struct allocator* allocator)
+{
+    allocator = allocator_or_default(allocator);
+    struct buffer* buf = allocator_calloc(allocator, sizeof(struct buffer));
+    buf->allocator = allocator;
+    buf->data = allocator_calloc(allocator, BUFFER_REALLOC_AMOUNT);
+    HELPER_STATS_ADD(buffer_creates, 1);
+    HELPER_STATS_ADD(bytes_allocated, BUFFER_REALLOC_AMOUNT);
     buf->len = 0;
     buf->msize = BUFFER_REALLOC_AMOUNT;
     return buf;
 }
 
+struct buffer* buffer_create_arena(struct arena* arena, size_t size)
+{
+    struct buffer* buf = arena_calloc(arena, sizeof(struct buffer));
+    buf->data = arena_alloc(arena, size);
+    // The bytes belong to the arena and are not counted as allocated
+    HELPER_STATS_ADD(buffer_creates, 1);
+    buf->len = 0;
+    buf->msize = size;
+    buf->arena = arena;
+    return buf;
+}
+
+struct buffer* buffer_create_rope(size_t chunk_size)
+{
+    return buffer_create_rope_allocator(chunk_size, NULL);
+}
+
+struct buffer* buffer_create_rope_allocator(size_t chunk_size, struct allocator* allocator)
+{
+    if (chunk_size == 0)
+    {
+        chunk_size = BUFFER_ROPE_CHUNK_SIZE;
+    }
+
+    allocator = allocator_or_default(allocator);
+    struct buffer* buf = allocator_calloc(allocator, sizeof(struct buffer));
+    buf->allocator = allocator;
+    buf->data = allocator_alloc(buf->allocator, chunk_size);
+    HELPER_STATS_ADD(buffer_creates, 1);
+    HELPER_STATS_ADD(bytes_allocated, chunk_size);
+    buf->len = 0;
+    buf->msize = chunk_size;
+    buf->flags = BUFFER_FLAG_ROPE;
+    buf->chunk_size = chunk_size;
+    return buf;
+}
+
+static void buffer_rope_next_chunk(struct buffer* buffer, size_t size)
+{
+    size_t chunk_size = buffer->chunk_size > size ? buffer->chunk_size : size;
+    if (buffer->len == 0)
+    {
+        // Nothing was written to the current chunk, just swap it for a bigger one
+        allocator_free(buffer->allocator, buffer->data, buffer->msize);
+    }
+    else
+    {
+        struct buffer_chunk* chunk = allocator_alloc(buffer->allocator, sizeof(struct buffer_chunk));
+        chunk->data = buffer->data;
+        chunk->len = buffer->len;
+        chunk->size = buffer->msize;
+        chunk->next = NULL;
+        if (buffer->last_chunk)
+        {
+            buffer->last_chunk->next = chunk;
+        }
+        else
+        {
+            buffer->chunks = chunk;
+        }
+        buffer->last_chunk = chunk;
+    }
+
+    buffer->data = allocator_alloc(buffer->allocator, chunk_size);
+    HELPER_STATS_ADD(bytes_allocated, chunk_size);
+    buffer->len = 0;
+    buffer->msize = chunk_size;
+}
+
 void buffer_extend(struct buffer* buffer, size_t size)
 {
-    buffer->data = realloc(buffer->data, buffer->msize+size);
+    if (buffer->flags & BUFFER_FLAG_ROPE)
+    {
+        // Chunks never grow, the room has to come from a new one
+        buffer_need(buffer, size);
+        return;
+    }
+
+    if (buffer->arena)
+    {
+        buffer->data = arena_realloc(buffer->arena, buffer->data, buffer->msize, buffer->msize+size);
+    }
+    else
+    {
+        buffer->data = allocator_realloc(buffer->allocator, buffer->data, buffer->msize, buffer->msize+size);
+        HELPER_STATS_ADD(bytes_allocated, size);
+    }
     buffer->msize+=size;
 }
 
 void buffer_need(struct buffer* buffer, size_t size)
 {
-    if (buffer->msize <= (buffer->len+size))
+    // Always keep a byte spare for the terminator
+    size_t required = buffer->len + size + 1;
+    if (required <= (size_t)buffer->msize)
+    {
+        return;
+    }
+
+    if (buffer->flags & BUFFER_FLAG_ROPE)
     {
-        size += BUFFER_REALLOC_AMOUNT;
-        buffer_extend(buffer, size);
+        buffer_rope_next_chunk(buffer, size + 1);
+        return;
     }
+
+    // Double so that many small writes only copy O(N) bytes in total
+    size_t new_size = buffer->msize * 2;
+    if (new_size < required)
+    {
+        new_size = required;
+    }
+    buffer_extend(buffer, new_size - buffer->msize);
 }
 
+void buffer_vprintf(struct buffer* buffer, const char* fmt, va_list args)
+{
+    va_list args_again;
+    va_copy(args_again, args);
+
+    // Try formatting straight into the space we have, most writes are small
+    // enough to fit so the second pass is rare
+    size_t available = buffer->msize - buffer->len;
+    int len = vsnprintf(&buffer->data[buffer->len], available, fmt, args);
+    if (len >= 0 && (size_t)len >= available)
+    {
+        buffer_need(buffer, len);
+        vsnprintf(&buffer->data[buffer->len], buffer->msize - buffer->len, fmt, args_again);
+    }
+    va_end(args_again);
+
+    if (len > 0)
+    {
+        buffer->len += len;
+    }
+}
 
 void buffer_printf(struct buffer* buffer, const char* fmt, ...)
 {
     va_list args;
     va_start(args, fmt);
-    int index = buffer->len;
-    // Temporary, this is a limitation we are guessing the size is no more than 2048
-    int len = 2048;
-    buffer_extend(buffer, len);
-    int actual_len = vsnprintf(&buffer->data[index], len, fmt, args);
-    buffer->len += actual_len;
+    buffer_vprintf(buffer, fmt, args);
     va_end(args);
 }
 
 void buffer_printf_no_terminator(struct buffer* buffer, const char* fmt, ...)
 {
+    // Whatever buffer_vprintf leaves past the length is not part of the data
     va_list args;
     va_start(args, fmt);
-    int index = buffer->len;
-    // Temporary, this is a limitation we are guessing the size is no more than 2048
-    int len = 2048;
-    buffer_extend(buffer, len);
-    int actual_len = vsnprintf(&buffer->data[index], len, fmt, args);
-    buffer->len += actual_len-1;
+    buffer_vprintf(buffer, fmt, args);
     va_end(args);
 }
 
@@ -62,11 +194,124 @@ void buffer_write(struct buffer* buffer, char c)
     buffer->len++;
 }
 
+void buffer_write_bytes(struct buffer* buffer, const void* ptr, size_t size)
+{
+    buffer_need(buffer, size);
+
+    memcpy(&buffer->data[buffer->len], ptr, size);
+    buffer->len += size;
+}
+
+static void buffer_rope_collapse(struct buffer* buffer)
+{
+    if (!buffer->chunks)
+    {
+        return;
+    }
+
+    size_t total = buffer_len(buffer);
+    char* data = allocator_alloc(buffer->allocator, total + 1);
+    size_t index = 0;
+    struct buffer_chunk* chunk = buffer->chunks;
+    while (chunk)
+    {
+        struct buffer_chunk* next = chunk->next;
+        memcpy(&data[index], chunk->data, chunk->len);
+        index += chunk->len;
+        allocator_free(buffer->allocator, chunk->data, chunk->size);
+        allocator_free(buffer->allocator, chunk, sizeof(struct buffer_chunk));
+        chunk = next;
+    }
+    memcpy(&data[index], buffer->data, buffer->len);
+    data[total] = 0x00;
+    allocator_free(buffer->allocator, buffer->data, buffer->msize);
+
+    buffer->chunks = NULL;
+    buffer->last_chunk = NULL;
+    buffer->data = data;
+    buffer->len = total;
+    buffer->msize = total + 1;
+}
+
 void* buffer_ptr(struct buffer* buffer)
 {
+    if (buffer->flags & BUFFER_FLAG_ROPE)
+    {
+        buffer_rope_collapse(buffer);
+    }
     return buffer->data;
 }
 
+size_t buffer_len(struct buffer* buffer)
+{
+    size_t len = buffer->len;
+    for (struct buffer_chunk* chunk = buffer->chunks; chunk; chunk = chunk->next)
+    {
+        len += chunk->len;
+    }
+    return len;
+}
+
+static int buffer_writev_all(int fd, struct iovec* iov, int count)
+{
+    while (count > 0)
+    {
+        ssize_t written = writev(fd, iov, count < IOV_MAX ? count : IOV_MAX);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+
+        // Skip everything that made it out, a short write can stop half way
+        // through an iovec
+        while (count > 0 && (size_t)written >= iov->iov_len)
+        {
+            written -= iov->iov_len;
+            iov++;
+            count--;
+        }
+
+        if (count > 0)
+        {
+            iov->iov_base = (char*)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+
+    return 0;
+}
+
+int buffer_writev(struct buffer* buffer, FILE* fp)
+{
+    int count = 1;
+    for (struct buffer_chunk* chunk = buffer->chunks; chunk; chunk = chunk->next)
+    {
+        count++;
+    }
+
+    // Buffers made from an arena have no allocator of their own
+    struct allocator* allocator = allocator_or_default(buffer->allocator);
+    struct iovec* iov = allocator_alloc(allocator, sizeof(struct iovec) * count);
+    int index = 0;
+    for (struct buffer_chunk* chunk = buffer->chunks; chunk; chunk = chunk->next)
+    {
+        iov[index].iov_base = chunk->data;
+        iov[index].iov_len = chunk->len;
+        index++;
+    }
+    iov[index].iov_base = buffer->data;
+    iov[index].iov_len = buffer->len;
+
+    // Anything already sitting in the stdio buffer has to go out before us
+    int res = fflush(fp) == 0 ? buffer_writev_all(fileno(fp), iov, count) : -1;
+    allocator_free(allocator, iov, sizeof(struct iovec) * count);
+    return res;
+}
+
 char buffer_read(struct buffer* buffer)
 {
     if (buffer->rindex >= buffer->len)
@@ -88,10 +333,47 @@ char buffer_peek(struct buffer* buffer)
     return c;
 }
 
+static void buffer_free_chunks(struct buffer* buffer)
+{
+    struct allocator* allocator = buffer->allocator;
+    struct buffer_chunk* chunk = buffer->chunks;
+    while (chunk)
+    {
+        struct buffer_chunk* next = chunk->next;
+        allocator_free(allocator, chunk->data, chunk->size);
+        allocator_free(allocator, chunk, sizeof(struct buffer_chunk));
+        chunk = next;
+    }
+    buffer->chunks = NULL;
+    buffer->last_chunk = NULL;
+}
+
+void buffer_clear(struct buffer* buffer)
+{
+    if (!buffer->arena)
+    {
+        buffer_free_chunks(buffer);
+    }
+
+    buffer->len = 0;
+    if (buffer->msize > 0)
+    {
+        buffer->data[0] = 0x00;
+    }
+}
+
 void buffer_free(struct buffer* buffer)
 {
-    free(buffer->data);
-    free(buffer);
+    if (buffer->arena)
+    {
+        // Released together with the arena
+        return;
+    }
+
+    struct allocator* allocator = buffer->allocator;
+    buffer_free_chunks(buffer);
+    allocator_free(allocator, buffer->data, buffer->msize);
+    allocator_free(allocator, buffer, sizeof(struct buffer));
 }
 
 
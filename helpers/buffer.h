@@ -3,8 +3,35 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdio.h>
+#include <stdarg.h>
 
 #define BUFFER_REALLOC_AMOUNT 2000
+// Initial size of buffers that live in an arena, they double when they run out
+#define BUFFER_ARENA_INITIAL_SIZE 32
+// Size of every chunk a rope buffer allocates unless a single write needs more
+#define BUFFER_ROPE_CHUNK_SIZE 65536
+
+enum
+{
+    // The buffer is a list of chunks that are never moved once written,
+    // see buffer_create_rope
+    BUFFER_FLAG_ROPE = 0b00000001
+};
+
+struct arena;
+struct allocator;
+
+// A full chunk of a rope buffer
+struct buffer_chunk
+{
+    char* data;
+    size_t len;
+    // Bytes allocated for data
+    size_t size;
+    struct buffer_chunk* next;
+};
+
 struct buffer
 {
     char* data;
@@ -12,18 +39,99 @@ struct buffer
     int rindex;
     int len;
     int msize;
+
+    // The arena the data lives in, NULL if it was allocated on the heap.
+    // Arena buffers are released together with their arena.
+    struct arena* arena;
+    // Where the heap memory of non arena buffers comes from, see allocator.h
+    struct allocator* allocator;
+
+    int flags;
+
+    // Rope buffers only. The chunks that filled up before the current one,
+    // data, len and msize always describe the chunk being written.
+    struct buffer_chunk* chunks;
+    struct buffer_chunk* last_chunk;
+    size_t chunk_size;
 };
 
 struct buffer* buffer_create();
 
+/**
+ * Creates a buffer that gets all its memory from the given allocator.
+ * \param allocator Has to outlive the buffer, NULL for the libc allocator
+ */
+struct buffer* buffer_create_allocator(struct allocator* allocator);
+
+/**
+ * Creates a buffer whose structure and data are allocated from the given arena.
+ * \param size The initial size of the buffer, it grows as needed
+ */
+struct buffer* buffer_create_arena(struct arena* arena, size_t size);
+
+/**
+ * Creates a write only buffer made of fixed chunks. Nothing is ever copied
+ * when it grows and it can be written out with buffer_writev without building
+ * one contiguous string first.
+ * \param chunk_size The size of each chunk, zero for BUFFER_ROPE_CHUNK_SIZE
+ */
+struct buffer* buffer_create_rope(size_t chunk_size);
+
+/**
+ * Same as buffer_create_rope with the structure and every chunk coming from
+ * the given allocator.
+ * \param allocator Has to outlive the buffer, NULL for the libc allocator
+ */
+struct buffer* buffer_create_rope_allocator(size_t chunk_size, struct allocator* allocator);
+
 char buffer_read(struct buffer* buffer);
 char buffer_peek(struct buffer* buffer);
 
 void buffer_extend(struct buffer* buffer, size_t size);
+
+/**
+ * Makes sure there is room for size more bytes, growing the buffer geometrically
+ */
+void buffer_need(struct buffer* buffer, size_t size);
+
+/**
+ * Appends the formatted string. The data is always NULL terminated after it,
+ * the terminator is not counted in the length.
+ */
 void buffer_printf(struct buffer* buffer, const char* fmt, ...);
+void buffer_vprintf(struct buffer* buffer, const char* fmt, va_list args);
+
+/**
+ * Appends the formatted string for data that is only read by its length,
+ * no terminator is promised after it. Sized the same as buffer_printf.
+ */
 void buffer_printf_no_terminator(struct buffer* buffer, const char* fmt, ...);
 void buffer_write(struct buffer* buffer, char c);
+void buffer_write_bytes(struct buffer* buffer, const void* ptr, size_t size);
+
+/**
+ * Returns the data of the buffer. Rope buffers are collapsed into a single
+ * chunk first, prefer buffer_writev for them.
+ */
 void* buffer_ptr(struct buffer* buffer);
+
+/**
+ * The total amount of bytes written to the buffer, every chunk included
+ */
+size_t buffer_len(struct buffer* buffer);
+
+/**
+ * Writes all the data of the buffer to the given file with writev,
+ * one iovec per chunk. The stream is flushed first so the order is kept.
+ * \return 0 on success, -1 if the write failed
+ */
+int buffer_writev(struct buffer* buffer, FILE* fp);
+
+/**
+ * Empties the buffer and keeps its memory for what is written next,
+ * rope buffers keep only their current chunk
+ */
+void buffer_clear(struct buffer* buffer);
 void buffer_free(struct buffer* buffer);
 
 
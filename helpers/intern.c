@@ -0,0 +1,165 @@
+#include "intern.h"
+#include "vector.h"
+#include "allocator.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+static uint32_t intern_hash(const char* str, size_t len)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= (unsigned char)str[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+struct intern_pool* intern_pool_create()
+{
+    return intern_pool_create_allocator(NULL);
+}
+
+struct intern_pool* intern_pool_create_allocator(struct allocator* allocator)
+{
+    allocator = allocator_or_default(allocator);
+    struct intern_pool* pool = allocator_calloc(allocator, sizeof(struct intern_pool));
+    pool->allocator = allocator;
+    pool->slots = allocator_calloc(allocator, INTERN_POOL_INITIAL_SLOTS * sizeof(uint32_t));
+    pool->slot_count = INTERN_POOL_INITIAL_SLOTS;
+    pool->entries = vector_create_allocator(sizeof(struct intern_entry), allocator);
+    pool->blocks = vector_create_allocator(sizeof(struct intern_block), allocator);
+    return pool;
+}
+
+void intern_pool_free(struct intern_pool* pool)
+{
+    struct allocator* allocator = pool->allocator;
+    for (int i = 0; i < vector_count(pool->blocks); i++)
+    {
+        struct intern_block* block = vector_at(pool->blocks, i);
+        allocator_free(allocator, block->data, block->size);
+    }
+
+    vector_free(pool->blocks);
+    vector_free(pool->entries);
+    allocator_free(allocator, pool->slots, pool->slot_count * sizeof(uint32_t));
+    allocator_free(allocator, pool, sizeof(struct intern_pool));
+}
+
+static char* intern_pool_store(struct intern_pool* pool, const char* str, size_t len)
+{
+    size_t size = len + 1;
+    if (size > INTERN_POOL_BLOCK_SIZE / 4)
+    {
+        // Large strings get a block of their own so they don't waste the current one
+        char* block = allocator_alloc(pool->allocator, size);
+        vector_push(pool->blocks, &(struct intern_block){.data = block, .size = size});
+        memcpy(block, str, len);
+        block[len] = 0x00;
+        return block;
+    }
+
+    if (!pool->block || pool->block_used + size > INTERN_POOL_BLOCK_SIZE)
+    {
+        pool->block = allocator_alloc(pool->allocator, INTERN_POOL_BLOCK_SIZE);
+        pool->block_used = 0;
+        vector_push(pool->blocks, &(struct intern_block){.data = pool->block, .size = INTERN_POOL_BLOCK_SIZE});
+    }
+
+    char* ptr = pool->block + pool->block_used;
+    pool->block_used += size;
+    memcpy(ptr, str, len);
+    ptr[len] = 0x00;
+    return ptr;
+}
+
+static void intern_pool_grow(struct intern_pool* pool)
+{
+    size_t slot_count = pool->slot_count * 2;
+    uint32_t* slots = allocator_calloc(pool->allocator, slot_count * sizeof(uint32_t));
+    size_t total = vector_count(pool->entries);
+    for (size_t id = 0; id < total; id++)
+    {
+        struct intern_entry* entry = vector_at(pool->entries, id);
+        size_t slot = entry->hash & (slot_count - 1);
+        while (slots[slot])
+        {
+            slot = (slot + 1) & (slot_count - 1);
+        }
+        slots[slot] = id + 1;
+    }
+
+    allocator_free(pool->allocator, pool->slots, pool->slot_count * sizeof(uint32_t));
+    pool->slots = slots;
+    pool->slot_count = slot_count;
+}
+
+uint32_t intern_pool_intern(struct intern_pool* pool, const char* str, size_t len)
+{
+    pool->stats.lookups++;
+
+    uint32_t hash = intern_hash(str, len);
+    size_t slot = hash & (pool->slot_count - 1);
+    while (pool->slots[slot])
+    {
+        uint32_t id = pool->slots[slot] - 1;
+        struct intern_entry* entry = vector_at(pool->entries, id);
+        if (entry->hash == hash && entry->len == len && memcmp(entry->str, str, len) == 0)
+        {
+            pool->stats.hits++;
+            pool->stats.bytes_saved += len + 1;
+            return id;
+        }
+        slot = (slot + 1) & (pool->slot_count - 1);
+    }
+
+    struct intern_entry entry = {.str = intern_pool_store(pool, str, len), .len = len, .hash = hash};
+    uint32_t id = vector_count(pool->entries);
+    vector_push(pool->entries, &entry);
+    pool->slots[slot] = id + 1;
+    pool->stats.unique++;
+    pool->stats.bytes_stored += len + 1;
+
+    // Keep the table at most half full so probe sequences stay short
+    if (pool->stats.unique * 2 > pool->slot_count)
+    {
+        intern_pool_grow(pool);
+    }
+
+    return id;
+}
+
+const char* intern_pool_str(struct intern_pool* pool, uint32_t id)
+{
+    assert(id < (uint32_t)vector_count(pool->entries));
+    struct intern_entry* entry = vector_at(pool->entries, id);
+    return entry->str;
+}
+
+size_t intern_pool_len(struct intern_pool* pool, uint32_t id)
+{
+    assert(id < (uint32_t)vector_count(pool->entries));
+    struct intern_entry* entry = vector_at(pool->entries, id);
+    return entry->len;
+}
+
+size_t intern_pool_count(struct intern_pool* pool)
+{
+    return vector_count(pool->entries);
+}
+
+void intern_pool_stats(struct intern_pool* pool, struct intern_stats* stats)
+{
+    *stats = pool->stats;
+}
+
+void intern_pool_print_stats(struct intern_pool* pool, FILE* fp)
+{
+    struct intern_stats* stats = &pool->stats;
+    double hit_rate = stats->lookups ? (double)stats->hits / stats->lookups * 100.0 : 0.0;
+    fprintf(fp, "intern pool: %zu lookups, %zu hits (%.1f%%), %zu unique, %zu bytes stored, %zu bytes saved\n",
+            stats->lookups, stats->hits, hit_rate, stats->unique, stats->bytes_stored, stats->bytes_saved);
+}
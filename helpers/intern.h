@@ -0,0 +1,98 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Number of hash slots a new pool starts with, always a power of two
+#define INTERN_POOL_INITIAL_SLOTS 1024
+// Interned strings are packed into blocks of this size so they never move
+#define INTERN_POOL_BLOCK_SIZE 65536
+
+struct intern_entry
+{
+    const char* str;
+    size_t len;
+    uint32_t hash;
+};
+
+struct allocator;
+
+// Memory strings are copied into
+struct intern_block
+{
+    char* data;
+    size_t size;
+};
+
+struct intern_stats
+{
+    // Total calls to intern_pool_intern
+    size_t lookups;
+    // Lookups that found the string already interned
+    size_t hits;
+    // Number of distinct strings in the pool
+    size_t unique;
+    // Bytes the pool holds for the distinct strings
+    size_t bytes_stored;
+    // Bytes that would have been allocated for the duplicates without interning
+    size_t bytes_saved;
+};
+
+struct intern_pool
+{
+    // Open addressing hash table holding entry id + 1, zero marks an empty slot
+    uint32_t* slots;
+    size_t slot_count;
+
+    // Vector of struct intern_entry, the index of an entry is its id
+    struct vector* entries;
+
+    // Vector of struct intern_block, every block that strings were copied into
+    struct vector* blocks;
+    char* block;
+    size_t block_used;
+
+    struct intern_stats stats;
+
+    // Where the slots, blocks and vectors come from
+    struct allocator* allocator;
+};
+
+struct intern_pool* intern_pool_create();
+
+/**
+ * Creates a pool that gets all its memory from the given allocator.
+ * \param allocator Has to outlive the pool, NULL for the libc allocator
+ */
+struct intern_pool* intern_pool_create_allocator(struct allocator* allocator);
+void intern_pool_free(struct intern_pool* pool);
+
+/**
+ * Interns the given string, equal strings always get the same id and pointer.
+ * \param str The string to intern, doesn't need to be NULL terminated
+ * \param len The length of the string
+ * \return Returns the dense id of the string, the first string interned gets zero
+ */
+uint32_t intern_pool_intern(struct intern_pool* pool, const char* str, size_t len);
+
+/**
+ * Returns the NULL terminated string of the given id, the pointer is valid
+ * for as long as the pool lives.
+ */
+const char* intern_pool_str(struct intern_pool* pool, uint32_t id);
+size_t intern_pool_len(struct intern_pool* pool, uint32_t id);
+
+/**
+ * Returns the amount of distinct strings in the pool
+ */
+size_t intern_pool_count(struct intern_pool* pool);
+
+/**
+ * Copies the hit rate and memory statistics of the pool into stats
+ */
+void intern_pool_stats(struct intern_pool* pool, struct intern_stats* stats);
+void intern_pool_print_stats(struct intern_pool* pool, FILE* fp);
+
+#endif
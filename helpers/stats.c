@@ -0,0 +1,10 @@
+#include "stats.h"
+
+__thread struct helper_stats* helper_stats_current;
+
+struct helper_stats* helper_stats_swap(struct helper_stats* stats)
+{
+    struct helper_stats* previous = helper_stats_current;
+    helper_stats_current = stats;
+    return previous;
+}
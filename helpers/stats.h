@@ -0,0 +1,42 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+
+// Counts what the helpers allocate on behalf of whoever installed counters
+// on the current thread with helper_stats_swap. Threadpool jobs count into
+// the counters of the thread that submitted them. Nothing is counted while
+// no counters are installed, and building with -DHELPER_STATS_DISABLED
+// compiles the counting out altogether.
+
+struct helper_stats
+{
+    size_t buffer_creates;
+    size_t vector_reallocs;
+    size_t bytes_allocated;
+};
+
+extern __thread struct helper_stats* helper_stats_current;
+
+#ifdef HELPER_STATS_DISABLED
+#define HELPER_STATS_ADD(field, amount) ((void)0)
+#else
+// The jobs of one compile may run on many threads at once
+#define HELPER_STATS_ADD(field, amount)                                          \
+    do                                                                           \
+    {                                                                            \
+        struct helper_stats* _stats = helper_stats_current;                      \
+        if (__builtin_expect(_stats != NULL, 0))                                 \
+        {                                                                        \
+            __atomic_fetch_add(&_stats->field, (amount), __ATOMIC_RELAXED);      \
+        }                                                                        \
+    } while (0)
+#endif
+
+/**
+ * Makes stats the counters of the current thread, NULL stops counting.
+ * \return The counters installed before, swap them back when done
+ */
+struct helper_stats* helper_stats_swap(struct helper_stats* stats);
+
+#endif
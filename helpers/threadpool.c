@@ -0,0 +1,282 @@
+#include "threadpool.h"
+#include "stats.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+
+// The pool and queue of the worker running on this thread, NULL outside a pool
+static __thread struct threadpool* threadpool_current;
+static __thread int threadpool_current_queue;
+
+struct threadpool_worker_start
+{
+    struct threadpool* pool;
+    int index;
+};
+
+static void threadpool_queue_init(struct threadpool_queue* queue)
+{
+    pthread_mutex_init(&queue->lock, NULL);
+    queue->jobs = malloc(sizeof(struct threadpool_job) * THREADPOOL_QUEUE_INITIAL_SIZE);
+    queue->head = 0;
+    queue->tail = 0;
+    queue->capacity = THREADPOOL_QUEUE_INITIAL_SIZE;
+}
+
+static void threadpool_queue_free(struct threadpool_queue* queue)
+{
+    pthread_mutex_destroy(&queue->lock);
+    free(queue->jobs);
+}
+
+static void threadpool_queue_grow(struct threadpool_queue* queue)
+{
+    size_t count = queue->tail - queue->head;
+    struct threadpool_job* jobs = malloc(sizeof(struct threadpool_job) * queue->capacity * 2);
+    for (size_t i = 0; i < count; i++)
+    {
+        jobs[i] = queue->jobs[(queue->head + i) % queue->capacity];
+    }
+
+    free(queue->jobs);
+    queue->jobs = jobs;
+    queue->head = 0;
+    queue->tail = count;
+    queue->capacity *= 2;
+}
+
+static void threadpool_queue_push(struct threadpool_queue* queue, struct threadpool_job* job)
+{
+    pthread_mutex_lock(&queue->lock);
+    if (queue->tail - queue->head == queue->capacity)
+    {
+        threadpool_queue_grow(queue);
+    }
+    queue->jobs[queue->tail % queue->capacity] = *job;
+    queue->tail++;
+    pthread_mutex_unlock(&queue->lock);
+}
+
+// The owner takes its newest job, it is the most likely to still be in cache
+static bool threadpool_queue_pop_tail(struct threadpool_queue* queue, struct threadpool_job* job)
+{
+    bool found = false;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->tail != queue->head)
+    {
+        queue->tail--;
+        *job = queue->jobs[queue->tail % queue->capacity];
+        found = true;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+// Thieves take the oldest job, leaving the owner its recent work
+static bool threadpool_queue_pop_head(struct threadpool_queue* queue, struct threadpool_job* job)
+{
+    bool found = false;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->tail != queue->head)
+    {
+        *job = queue->jobs[queue->head % queue->capacity];
+        queue->head++;
+        found = true;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+/**
+ * Finds a job for a thread that already took one from pool->queued. A job is
+ * always pushed before it is counted so there is one to be found, though we
+ * may have to look again if another thread got to it first.
+ */
+static void threadpool_take_job(struct threadpool* pool, int own_queue, struct threadpool_job* job)
+{
+    while (1)
+    {
+        if (own_queue >= 0 && threadpool_queue_pop_tail(&pool->queues[own_queue], job))
+        {
+            return;
+        }
+
+        int start = own_queue >= 0 ? own_queue + 1 : 0;
+        for (int i = 0; i < pool->total_threads; i++)
+        {
+            int victim = (start + i) % pool->total_threads;
+            if (victim != own_queue && threadpool_queue_pop_head(&pool->queues[victim], job))
+            {
+                return;
+            }
+        }
+
+        sched_yield();
+    }
+}
+
+static void threadpool_run_job(struct threadpool* pool, struct threadpool_job* job)
+{
+    struct helper_stats* stats = helper_stats_swap(job->stats);
+    job->function(job->arg);
+    helper_stats_swap(stats);
+
+    pthread_mutex_lock(&pool->lock);
+    job->group->pending--;
+    if (job->group->pending == 0)
+    {
+        // Whoever waits on this group is asleep on the same condition
+        pthread_cond_broadcast(&pool->wakeup);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static int threadpool_own_queue(struct threadpool* pool)
+{
+    return threadpool_current == pool ? threadpool_current_queue : -1;
+}
+
+static void* threadpool_worker(void* arg)
+{
+    struct threadpool_worker_start* start = arg;
+    struct threadpool* pool = start->pool;
+    threadpool_current = pool;
+    threadpool_current_queue = start->index;
+    free(start);
+
+    while (1)
+    {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->queued == 0 && !pool->stopping)
+        {
+            pthread_cond_wait(&pool->wakeup, &pool->lock);
+        }
+
+        if (pool->queued == 0)
+        {
+            // Stopping and nothing is left to do
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        pool->queued--;
+        pthread_mutex_unlock(&pool->lock);
+
+        struct threadpool_job job;
+        threadpool_take_job(pool, threadpool_current_queue, &job);
+        threadpool_run_job(pool, &job);
+    }
+
+    return NULL;
+}
+
+struct threadpool* threadpool_create(int total_threads)
+{
+    if (total_threads <= 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        total_threads = cpus > 0 ? cpus : 1;
+    }
+
+    struct threadpool* pool = calloc(sizeof(struct threadpool), 1);
+    pool->total_threads = total_threads;
+    pool->threads = calloc(sizeof(pthread_t), total_threads);
+    pool->queues = calloc(sizeof(struct threadpool_queue), total_threads);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wakeup, NULL);
+
+    for (int i = 0; i < total_threads; i++)
+    {
+        threadpool_queue_init(&pool->queues[i]);
+    }
+
+    for (int i = 0; i < total_threads; i++)
+    {
+        struct threadpool_worker_start* start = malloc(sizeof(struct threadpool_worker_start));
+        start->pool = pool;
+        start->index = i;
+        pthread_create(&pool->threads[i], NULL, threadpool_worker, start);
+    }
+
+    return pool;
+}
+
+void threadpool_free(struct threadpool* pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->wakeup);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->total_threads; i++)
+    {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    for (int i = 0; i < pool->total_threads; i++)
+    {
+        threadpool_queue_free(&pool->queues[i]);
+    }
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wakeup);
+    free(pool->queues);
+    free(pool->threads);
+    free(pool);
+}
+
+int threadpool_total_threads(struct threadpool* pool)
+{
+    return pool->total_threads;
+}
+
+void threadpool_submit(struct threadpool* pool, struct threadpool_group* group, THREADPOOL_JOB_FUNCTION function, void* arg)
+{
+    struct threadpool_job job = {.function = function, .arg = arg, .group = group, .stats = helper_stats_current};
+
+    int queue = threadpool_own_queue(pool);
+    pthread_mutex_lock(&pool->lock);
+    if (queue < 0)
+    {
+        queue = pool->next_queue;
+        pool->next_queue = (pool->next_queue + 1) % pool->total_threads;
+    }
+
+    group->pending++;
+    threadpool_queue_push(&pool->queues[queue], &job);
+    pool->queued++;
+    pthread_cond_signal(&pool->wakeup);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void threadpool_wait(struct threadpool* pool, struct threadpool_group* group)
+{
+    int own_queue = threadpool_own_queue(pool);
+    pthread_mutex_lock(&pool->lock);
+    while (group->pending > 0)
+    {
+        if (pool->queued == 0)
+        {
+            pthread_cond_wait(&pool->wakeup, &pool->lock);
+            continue;
+        }
+
+        // Help out instead of sleeping, this may well be a job of another group
+        pool->queued--;
+        pthread_mutex_unlock(&pool->lock);
+
+        struct threadpool_job job;
+        threadpool_take_job(pool, own_queue, &job);
+        threadpool_run_job(pool, &job);
+
+        pthread_mutex_lock(&pool->lock);
+    }
+
+    // We might have been handed the wakeup meant for a worker just as the
+    // group finished, pass it on
+    if (pool->queued > 0)
+    {
+        pthread_cond_signal(&pool->wakeup);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,90 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+// Initial amount of jobs every worker queue holds, they double when full
+#define THREADPOOL_QUEUE_INITIAL_SIZE 64
+
+typedef void (*THREADPOOL_JOB_FUNCTION)(void* arg);
+
+struct threadpool_job
+{
+    THREADPOOL_JOB_FUNCTION function;
+    void* arg;
+    struct threadpool_group* group;
+    // Allocation counters of the submitting thread, see stats.h
+    struct helper_stats* stats;
+};
+
+/**
+ * A double ended queue of jobs owned by one worker. The owner takes the
+ * newest job from the tail, idle workers steal the oldest from the head.
+ */
+struct threadpool_queue
+{
+    pthread_mutex_t lock;
+    struct threadpool_job* jobs;
+    // Jobs live in [head, tail), both wrap around capacity
+    size_t head;
+    size_t tail;
+    size_t capacity;
+};
+
+/**
+ * A set of jobs that can be waited on together, jobs of different groups
+ * can share the same pool.
+ */
+struct threadpool_group
+{
+    // Jobs of this group that were submitted but have not finished
+    size_t pending;
+};
+
+struct threadpool
+{
+    int total_threads;
+    pthread_t* threads;
+    // One queue per worker
+    struct threadpool_queue* queues;
+
+    // Guards the counters below and pairs with wakeup
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+
+    // Jobs sitting in any of the queues, a thread may only go looking
+    // for a job after it took one from this count
+    size_t queued;
+    // Round robin over the worker queues for jobs submitted from outside
+    int next_queue;
+    bool stopping;
+};
+
+/**
+ * Starts a pool with the given amount of worker threads
+ * \param total_threads Zero or less uses one thread per online CPU
+ */
+struct threadpool* threadpool_create(int total_threads);
+
+/**
+ * Waits for all queued jobs to finish, stops the workers and frees the pool
+ */
+void threadpool_free(struct threadpool* pool);
+
+int threadpool_total_threads(struct threadpool* pool);
+
+/**
+ * Queues a job in the given group. Jobs submitted from a worker go to the
+ * queue of that worker, others are spread over all workers.
+ */
+void threadpool_submit(struct threadpool* pool, struct threadpool_group* group, THREADPOOL_JOB_FUNCTION function, void* arg);
+
+/**
+ * Blocks until every job of the group has finished. The calling thread runs
+ * queued jobs while it waits, so jobs may wait on groups of their own.
+ */
+void threadpool_wait(struct threadpool* pool, struct threadpool_group* group);
+
+#endif
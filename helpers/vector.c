@@ -1,5 +1,7 @@
 
 #include "vector.h"
+#include "stats.h"
+#include "allocator.h"
 #include <memory.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -21,11 +23,13 @@ static void vector_assert_bounds_for_pop(struct vector *vector, int index)
     assert(vector_in_bounds_for_pop(vector, index));
 }
 
-struct vector *vector_create_no_saves(size_t esize)
+static struct vector *vector_create_no_saves(size_t esize, struct allocator *allocator)
 {
-    struct vector *vector = calloc(sizeof(struct vector), 1);
-    vector->data = malloc(esize * VECTOR_ELEMENT_INCREMENT);
+    struct vector *vector = allocator_calloc(allocator, sizeof(struct vector));
+    vector->allocator = allocator;
+    vector->data = allocator_alloc(allocator, esize * VECTOR_ELEMENT_INCREMENT);
     vector->mindex = VECTOR_ELEMENT_INCREMENT;
+    HELPER_STATS_ADD(bytes_allocated, esize * VECTOR_ELEMENT_INCREMENT);
     vector->rindex = 0;
     vector->pindex = 0;
     vector->esize = esize;
@@ -45,28 +49,40 @@ size_t vector_element_size(struct vector *vector)
 
 struct vector *vector_clone(struct vector *vector)
 {
-    void *new_data_address = calloc(vector->esize, vector->count + VECTOR_ELEMENT_INCREMENT);
+    // Same capacity as the original as mindex is copied along with the rest
+    void *new_data_address = allocator_calloc(vector->allocator, vector->esize * vector->mindex);
     memcpy(new_data_address, vector->data, vector_total_size(vector));
-    struct vector *new_vec = calloc(sizeof(struct vector), 1);
+    struct vector *new_vec = allocator_alloc(vector->allocator, sizeof(struct vector));
     memcpy(new_vec, vector, sizeof(struct vector));
     new_vec->data = new_data_address;
 
-    // Saves are not cloned with vector_clone yet.
-    // assert(vector->saves == NULL);
+    // Saves are not cloned with vector_clone yet, the clone starts without any
+    new_vec->saves = vector_create_no_saves(sizeof(struct vector), vector->allocator);
     return new_vec;
 }
 
 struct vector *vector_create(size_t esize)
 {
-    struct vector *vec = vector_create_no_saves(esize);
-    vec->saves = vector_create_no_saves(sizeof(struct vector));
+    return vector_create_allocator(esize, NULL);
+}
+
+struct vector *vector_create_allocator(size_t esize, struct allocator *allocator)
+{
+    allocator = allocator_or_default(allocator);
+    struct vector *vec = vector_create_no_saves(esize, allocator);
+    vec->saves = vector_create_no_saves(sizeof(struct vector), allocator);
     return vec;
 }
 
 void vector_free(struct vector *vector)
 {
-    free(vector->data);
-    free(vector);
+    struct allocator *allocator = vector->allocator;
+    if (vector->saves)
+    {
+        vector_free(vector->saves);
+    }
+    allocator_free(allocator, vector->data, vector->mindex * vector->esize);
+    allocator_free(allocator, vector, sizeof(struct vector));
 }
 
 int vector_current_index(struct vector *vector)
@@ -74,17 +90,53 @@ int vector_current_index(struct vector *vector)
     return vector->rindex;
 }
 
+static void vector_set_capacity(struct vector *vector, int capacity)
+{
+    if (capacity > vector->mindex)
+    {
+        HELPER_STATS_ADD(vector_reallocs, 1);
+        HELPER_STATS_ADD(bytes_allocated, (capacity - vector->mindex) * vector->esize);
+    }
+    vector->data = allocator_realloc(vector->allocator, vector->data, vector->mindex * vector->esize, capacity * vector->esize);
+    assert(vector->data);
+    vector->mindex = capacity;
+}
+
 void vector_resize_for_index(struct vector *vector, int start_index, int total_elements)
 {
-    if (start_index + total_elements < vector->mindex)
+    // We always keep at least one free element past the index so vector_push
+    // can write before it checks for room
+    int required = start_index + total_elements;
+    if (required < vector->mindex)
     {
         // Nothing to resize
         return;
     }
 
-    vector->data = realloc(vector->data, ((start_index + total_elements + VECTOR_ELEMENT_INCREMENT) * vector->esize));
-    assert(vector->data);
-    vector->mindex = start_index + total_elements;
+    // Grow geometrically so pushing N elements only copies O(N) elements in total
+    int capacity = vector->mindex > 0 ? vector->mindex : VECTOR_ELEMENT_INCREMENT;
+    while (capacity <= required)
+    {
+        capacity *= VECTOR_GROWTH_FACTOR;
+    }
+
+    vector_set_capacity(vector, capacity);
+}
+
+void vector_reserve(struct vector *vector, int total_elements)
+{
+    vector_resize_for_index(vector, 0, total_elements);
+}
+
+void vector_shrink_to_fit(struct vector *vector)
+{
+    // Keep the free element vector_push relies on
+    vector_set_capacity(vector, vector->rindex + 1);
+}
+
+int vector_capacity(struct vector *vector)
+{
+    return vector->mindex;
 }
 
 void vector_resize_for(struct vector *vector, int total_elements)
@@ -281,10 +333,11 @@ int vector_elements_until_end(struct vector *vector, int index)
 
 void vector_shift_right_in_bounds_no_increment(struct vector *vector, int index, int amount)
 {
-    vector_resize_for_index(vector, index, amount);
+    // Every element after index moves up, so we need room for all of them
+    vector_resize_for_index(vector, vector->rindex, amount);
     int eindex = (index + amount);
     size_t bytes_to_move = vector_elements_until_end(vector, index) * vector->esize;
-    memcpy(vector_at(vector, eindex), vector_at(vector, index), bytes_to_move);
+    memmove(vector_at(vector, eindex), vector_at(vector, index), bytes_to_move);
     memset(vector_at(vector, index), 0x00, amount * vector->esize);
 }
 
@@ -305,6 +358,16 @@ void vector_stretch(struct vector *vector, int index)
     vector->rindex = index;
 }
 
+void vector_splice(struct vector *vector, int index, int removed, void *elements, int total)
+{
+    int moved = vector->rindex - index - removed;
+    vector_resize_for_index(vector, index + total, moved);
+    memmove(vector_at(vector, index + total), vector_at(vector, index + removed), moved * vector->esize);
+    memcpy(vector_at(vector, index), elements, total * vector->esize);
+    vector->count += total - removed;
+    vector->rindex += total - removed;
+}
+
 int vector_pop_value(struct vector* vector, void* val)
 {
     int old_pp = vector->pindex;
@@ -352,7 +415,7 @@ void vector_pop_at(struct vector *vector, int index)
     void *next_element_pos = dst_pos + vector->esize;
     void *end_pos = vector_data_end(vector);
     size_t total = (size_t)end_pos - (size_t)next_element_pos;
-    memcpy(dst_pos, next_element_pos, total);
+    memmove(dst_pos, next_element_pos, total);
     vector->count -= 1;
     vector->rindex -= 1;
 }
@@ -7,9 +7,12 @@
 #include <stdlib.h>
 #include <stdio.h>
 
-// We want at least 20 vector element spaces in reserve before having
-// to reallocate memory again
+// The capacity of a new vector, in elements
 #define VECTOR_ELEMENT_INCREMENT 20
+// The capacity is multiplied by this every time the vector runs out of room
+#define VECTOR_GROWTH_FACTOR 2
+
+struct allocator;
 
 enum
 {
@@ -23,11 +26,14 @@ struct vector
     // This index will then be incremented
     int pindex;
     int rindex;
+    // The capacity, the amount of elements data has room for
     int mindex;
     int count;
     int flags;
     size_t esize;
 
+    // Where data and the vector its self come from, see allocator.h
+    struct allocator* allocator;
 
     // Vector of struct vector, holds saves of this vector. YOu can save the internal state
     // at all times with vector_save
@@ -39,6 +45,12 @@ struct vector
 
 
 struct vector* vector_create(size_t esize);
+
+/**
+ * Creates a vector that gets all its memory from the given allocator.
+ * \param allocator Has to outlive the vector, NULL for the libc allocator
+ */
+struct vector* vector_create_allocator(size_t esize, struct allocator* allocator);
 void vector_free(struct vector* vector);
 void* vector_at(struct vector* vector, int index);
 void* vector_peek_ptr_at(struct vector* vector, int index);
@@ -84,6 +96,33 @@ bool vector_empty(struct vector* vector);
 void vector_clear(struct vector* vector);
 
 int vector_count(struct vector* vector);
+
+/**
+ * Returns the amount of elements the vector has room for before it has to grow
+ */
+int vector_capacity(struct vector* vector);
+
+/**
+ * Makes sure the vector can hold at least total_elements without reallocating
+ */
+void vector_reserve(struct vector* vector, int total_elements);
+
+/**
+ * Sets the count of the vector to index if it holds fewer elements, the
+ * elements added this way are left for the caller to fill in with vector_at
+ */
+void vector_stretch(struct vector* vector, int index);
+
+/**
+ * Replaces removed elements from index on with total elements, the elements
+ * after them are moved once
+ */
+void vector_splice(struct vector* vector, int index, int removed, void* elements, int total);
+
+/**
+ * Releases the capacity the vector doesn't use
+ */
+void vector_shrink_to_fit(struct vector* vector);
 /**
  * freads from the file directly into the vector
  */
@@ -0,0 +1,115 @@
+#include "compiler.h"
+
+#define KEYWORD_HASH_SIZE 64
+#define KEYWORD_MIN_LENGTH 2
+#define KEYWORD_MAX_LENGTH 18
+
+typedef struct _keyword_entry_s
+{
+    const char *name;
+    size_t len;
+} keyword_entry_s;
+
+#define KEYWORD_ENTRY(str) {.name = str, .len = sizeof(str) - 1}
+
+static const keyword_entry_s keyword_entries[KEYWORD_COUNT] =
+{
+    [KEYWORD_NONE] = {.name = NULL, .len = 0},
+    [KEYWORD_UNSIGNED] = KEYWORD_ENTRY("unsigned"),
+    [KEYWORD_SIGNED] = KEYWORD_ENTRY("signed"),
+    [KEYWORD_CHAR] = KEYWORD_ENTRY("char"),
+    [KEYWORD_SHORT] = KEYWORD_ENTRY("short"),
+    [KEYWORD_INT] = KEYWORD_ENTRY("int"),
+    [KEYWORD_LONG] = KEYWORD_ENTRY("long"),
+    [KEYWORD_FLOAT] = KEYWORD_ENTRY("float"),
+    [KEYWORD_DOUBLE] = KEYWORD_ENTRY("double"),
+    [KEYWORD_VOID] = KEYWORD_ENTRY("void"),
+    [KEYWORD_STRUCT] = KEYWORD_ENTRY("struct"),
+    [KEYWORD_UNION] = KEYWORD_ENTRY("union"),
+    [KEYWORD_STATIC] = KEYWORD_ENTRY("static"),
+    [KEYWORD_IGNORE_TYPECHECK] = KEYWORD_ENTRY("__ignore_typecheck"),
+    [KEYWORD_RETURN] = KEYWORD_ENTRY("return"),
+    [KEYWORD_INCLUDE] = KEYWORD_ENTRY("include"),
+    [KEYWORD_SIZEOF] = KEYWORD_ENTRY("sizeof"),
+    [KEYWORD_IF] = KEYWORD_ENTRY("if"),
+    [KEYWORD_ELSE] = KEYWORD_ENTRY("else"),
+    [KEYWORD_WHILE] = KEYWORD_ENTRY("while"),
+    [KEYWORD_FOR] = KEYWORD_ENTRY("for"),
+    [KEYWORD_DO] = KEYWORD_ENTRY("do"),
+    [KEYWORD_BREAK] = KEYWORD_ENTRY("break"),
+    [KEYWORD_CONTINUE] = KEYWORD_ENTRY("continue"),
+    [KEYWORD_SWITCH] = KEYWORD_ENTRY("switch"),
+    [KEYWORD_CASE] = KEYWORD_ENTRY("case"),
+    [KEYWORD_DEFAULT] = KEYWORD_ENTRY("default"),
+    [KEYWORD_GOTO] = KEYWORD_ENTRY("goto"),
+    [KEYWORD_TYPEDEF] = KEYWORD_ENTRY("typedef"),
+    [KEYWORD_CONST] = KEYWORD_ENTRY("const"),
+    [KEYWORD_EXTERN] = KEYWORD_ENTRY("extern"),
+    [KEYWORD_RESTRICT] = KEYWORD_ENTRY("restrict")
+};
+
+// Perfect hash slots, every keyword lands in its own slot of keyword_hash().
+// The coefficients in keyword_hash() were found with a brute force search over
+// the keyword list, so they must be searched again when a keyword is added.
+static const unsigned char keyword_slots[KEYWORD_HASH_SIZE] =
+{
+    [0] = KEYWORD_IF,
+    [2] = KEYWORD_RESTRICT,
+    [3] = KEYWORD_DO,
+    [4] = KEYWORD_SWITCH,
+    [9] = KEYWORD_DEFAULT,
+    [11] = KEYWORD_CONTINUE,
+    [12] = KEYWORD_SIGNED,
+    [13] = KEYWORD_DOUBLE,
+    [15] = KEYWORD_INT,
+    [17] = KEYWORD_GOTO,
+    [21] = KEYWORD_SHORT,
+    [23] = KEYWORD_FOR,
+    [28] = KEYWORD_INCLUDE,
+    [29] = KEYWORD_LONG,
+    [30] = KEYWORD_STRUCT,
+    [34] = KEYWORD_CHAR,
+    [35] = KEYWORD_TYPEDEF,
+    [40] = KEYWORD_EXTERN,
+    [42] = KEYWORD_RETURN,
+    [43] = KEYWORD_UNION,
+    [44] = KEYWORD_BREAK,
+    [46] = KEYWORD_WHILE,
+    [51] = KEYWORD_CASE,
+    [52] = KEYWORD_UNSIGNED,
+    [53] = KEYWORD_STATIC,
+    [57] = KEYWORD_FLOAT,
+    [58] = KEYWORD_VOID,
+    [59] = KEYWORD_IGNORE_TYPECHECK,
+    [61] = KEYWORD_ELSE,
+    [62] = KEYWORD_SIZEOF,
+    [63] = KEYWORD_CONST
+};
+
+static inline unsigned int keyword_hash(const char *str, size_t len)
+{
+    const unsigned char *s = (const unsigned char *)str;
+    return (len + s[0] * 4 + s[1] * 6 + s[len - 1] * 25) & (KEYWORD_HASH_SIZE - 1);
+}
+
+keyword_e keyword_lookup(const char *str, size_t len)
+{
+    if (len < KEYWORD_MIN_LENGTH || len > KEYWORD_MAX_LENGTH)
+    {
+        return KEYWORD_NONE;
+    }
+
+    keyword_e keyword = keyword_slots[keyword_hash(str, len)];
+    const keyword_entry_s *entry = &keyword_entries[keyword];
+    if (entry->len != len || memcmp(entry->name, str, len) != 0)
+    {
+        return KEYWORD_NONE;
+    }
+
+    return keyword;
+}
+
+const char *keyword_name(keyword_e keyword)
+{
+    return keyword_entries[keyword].name;
+}
@@ -0,0 +1,239 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <assert.h>
+#include <string.h>
+
+/**
+ * Index of the last token that starts before offset, -1 if there is none
+ */
+static int lex_incremental_token_before(vector_s *tokens, size_t offset)
+{
+    int low = 0;
+    int high = vector_count(tokens);
+    while (low < high)
+    {
+        int middle = low + (high - low) / 2;
+        token_s *token = vector_at(tokens, middle);
+        if (token->slice.offset < offset)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return low - 1;
+}
+
+/**
+ * Number of brackets that open before offset
+ */
+static int lex_incremental_brackets_before(vector_s *brackets, size_t offset)
+{
+    int low = 0;
+    int high = vector_count(brackets);
+    while (low < high)
+    {
+        int middle = low + (high - low) / 2;
+        lex_brackets_s *pair = vector_at(brackets, middle);
+        if (pair->start < offset)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+// A newline outside of parentheses leaves nothing of the lexer state behind,
+// the tokens after it only depend on the text after it
+static bool lex_incremental_is_restart(token_s *token)
+{
+    return token->type == TOKEN_TYPE_NEWLINE && !token->between_brackets;
+}
+
+/**
+ * Index of the newline the relex starts from, the last restart point that
+ * ends before the edit. -1 if the relex has to start at the beginning.
+ */
+static int lex_incremental_restart(vector_s *tokens, size_t offset)
+{
+    for (int index = lex_incremental_token_before(tokens, offset); index >= 0; index--)
+    {
+        if (lex_incremental_is_restart(vector_at(tokens, index)))
+        {
+            return index;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Moves the tokens and brackets after the relexed ones by the size change of
+ * the edit, from token index and bracket first_bracket on.
+ */
+static void lex_incremental_shift(lex_process_s *process, int index, int first_bracket, long shift, int line_shift, int bracket_shift)
+{
+    for (int i = first_bracket; i < vector_count(process->brackets); i++)
+    {
+        lex_brackets_s *pair = vector_at(process->brackets, i);
+        pair->start += shift;
+        if (pair->end)
+        {
+            pair->end += shift;
+        }
+    }
+
+    token_s *tokens = vector_data_ptr(process->token_vec);
+    for (int i = index; i < vector_count(process->token_vec); i++)
+    {
+        token_s *token = &tokens[i];
+        token->slice.offset += shift;
+        token->pos.line += line_shift;
+        if (token->between_brackets)
+        {
+            token->between_brackets += bracket_shift;
+        }
+    }
+}
+
+int lex_incremental(lex_process_s *process, size_t offset, size_t removed, size_t inserted)
+{
+    assert(!process->defer_brackets);
+
+    vector_s *tokens = process->token_vec;
+    int restart = lex_incremental_restart(tokens, offset);
+    token_s newline = {0};
+    if (restart >= 0)
+    {
+        newline = *(token_s *)vector_at(tokens, restart);
+    }
+
+    // How the lexer left off with the old source, for when the tokens resync
+    size_t old_end = process->offset;
+    pos_s old_end_pos = process->pos;
+    int old_expression_count = process->current_expression_count;
+
+    // The new tokens and brackets are collected aside while the old ones are
+    // still needed to find where the two agree again
+    int first_token = restart >= 0 ? restart : 0;
+    int first_bracket = restart >= 0 ? lex_incremental_brackets_before(process->brackets, newline.slice.offset) : 0;
+    vector_s *old_brackets = process->brackets;
+    vector_s *relexed = vector_create_allocator(sizeof(token_s), process->allocator);
+    process->brackets = vector_create_allocator(sizeof(lex_brackets_s), process->allocator);
+
+    if (restart >= 0)
+    {
+        // The newline is lexed again, the whitespace after it may have changed
+        lex_start(process, newline.slice.offset + newline.slice.length);
+        process->pos.line = newline.pos.line;
+        process->pos.col = newline.pos.col;
+        process->lookahead[0] = newline;
+        process->lookahead[0].whitespace = false;
+        process->lookahead_count = 1;
+    }
+    else
+    {
+        lex_start(process, 0);
+        process->pos.line = 1;
+        process->pos.col = 1;
+    }
+    process->compiler->pos.line = process->pos.line - 1;
+    process->compiler->pos.col = process->pos.col - 1;
+
+    // An error may have been there before the edit or be reported again
+    // past it, lex the whole source so they all come out once and in order
+    compile_process_s *compiler = process->compiler;
+    jmp_buf *error_jmp = compiler->error_jmp;
+    jmp_buf relex_jmp;
+    compiler->error_jmp = &relex_jmp;
+    if (setjmp(relex_jmp))
+    {
+        compiler->error_jmp = error_jmp;
+        vector_free(process->brackets);
+        vector_free(relexed);
+        process->brackets = old_brackets;
+        vector_clear(process->token_vec);
+        vector_clear(process->brackets);
+        process->pos.line = 1;
+        process->pos.col = 1;
+        compiler->pos.line = 0;
+        compiler->pos.col = 0;
+        return lex(process);
+    }
+
+    long shift = (long)inserted - (long)removed;
+    size_t edit_end = offset + inserted;
+    int resync = vector_count(tokens);
+    int line_shift = 0;
+    int total_new_brackets = -1;
+    for (token_s *token = lex_next(process); token; token = lex_next(process))
+    {
+        // Past the edit the sources are the same, once both lexers leave a
+        // newline at the same place outside of parentheses they stay in step
+        if (lex_incremental_is_restart(token) && token->slice.offset >= edit_end)
+        {
+            int index = lex_incremental_token_before(tokens, token->slice.offset - shift + 1);
+            token_s *old_token = index >= 0 ? vector_at(tokens, index) : NULL;
+            if (old_token && old_token->slice.offset == token->slice.offset - shift && lex_incremental_is_restart(old_token))
+            {
+                resync = index;
+                line_shift = token->pos.line - old_token->pos.line;
+                // The lookahead may have opened brackets past the newline already
+                total_new_brackets = lex_incremental_brackets_before(process->brackets, token->slice.offset);
+                break;
+            }
+        }
+
+        if (token->between_brackets)
+        {
+            token->between_brackets += first_bracket;
+        }
+        vector_push(relexed, token);
+    }
+
+    compiler->error_jmp = error_jmp;
+    vector_s *new_brackets = process->brackets;
+    process->brackets = old_brackets;
+    if (total_new_brackets < 0)
+    {
+        total_new_brackets = vector_count(new_brackets);
+    }
+    int old_first_bracket = vector_count(old_brackets);
+    if (resync < vector_count(tokens))
+    {
+        token_s *old_token = vector_at(tokens, resync);
+        old_first_bracket = lex_incremental_brackets_before(old_brackets, old_token->slice.offset);
+    }
+
+    vector_splice(tokens, first_token, resync - first_token, vector_data_ptr(relexed), vector_count(relexed));
+    vector_splice(old_brackets, first_bracket, old_first_bracket - first_bracket, vector_data_ptr(new_brackets), total_new_brackets);
+    int bracket_shift = total_new_brackets - (old_first_bracket - first_bracket);
+    int tail = first_token + vector_count(relexed);
+    if (tail < vector_count(tokens))
+    {
+        // An edit that keeps the size and the lines leaves the tail as it is
+        if (shift || line_shift || bracket_shift)
+        {
+            lex_incremental_shift(process, tail, first_bracket + total_new_brackets, shift, line_shift, bracket_shift);
+        }
+
+        // Leave the process as if it had lexed the whole source
+        process->offset = old_end + shift;
+        process->pos = old_end_pos;
+        process->pos.line += line_shift;
+        process->compiler->pos.line = process->pos.line - 1;
+        process->compiler->pos.col = process->pos.col - 1;
+        process->current_expression_count = old_expression_count;
+        process->lookahead_count = 0;
+        process->lookahead_end = true;
+    }
+
+    vector_free(new_brackets);
+    vector_free(relexed);
+    return LEXICAL_ANALYSIS_ALL_OK;
+}
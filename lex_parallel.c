@@ -0,0 +1,646 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include "helpers/intern.h"
+#include "helpers/threadpool.h"
+#include "helpers/allocator.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Inputs are only split when every chunk gets at least this many bytes
+#ifndef LEX_PARALLEL_MIN_CHUNK_SIZE
+#define LEX_PARALLEL_MIN_CHUNK_SIZE (256 * 1024)
+#endif
+// More chunks than threads so a slow chunk doesn't hold up the others
+#define LEX_PARALLEL_CHUNKS_PER_THREAD 4
+
+/**
+ * A newline aligned slice of the source. It is lexed on its own by assuming
+ * it doesn't start inside a string or comment, lex_parallel checks that
+ * assumption once the chunk before it is known to be right.
+ */
+struct lex_chunk
+{
+    // The chunk owns the tokens starting in [start, end), start is zero or
+    // right after a newline
+    size_t start;
+    size_t end;
+
+    // Newlines before start, the chunk lexer counts its lines from one
+    int lines_before;
+    int lines;
+
+    // A copy of the compiler with its own intern pool, so chunks never share
+    // anything while they are lexed. Errors jump back instead of exiting.
+    compile_process_s compiler;
+    jmp_buf error_jmp;
+    lex_process_s *lex_process;
+    bool failed;
+
+    // Offset of the first token the chunk lexer produced, or resume when there is none
+    size_t first;
+    // Offset of the first token at or past end, where the next chunk has to
+    // start for its tokens to be right. The size of the source at the end.
+    size_t resume;
+
+    // Per intern id of the chunk pool, the index plus one of the first token
+    // we keep that uses it and the id it has in the real pool
+    unsigned int *first_use;
+    unsigned int *sids;
+};
+
+/**
+ * A run of chunk tokens that goes into the final token vector as is
+ */
+struct lex_segment
+{
+    struct lex_chunk *chunk;
+    int first_token;
+    int total_tokens;
+    // Index of the first token in the final token vector
+    int output;
+
+    // Parentheses of the segment relative to the depth it starts at. Left
+    // parentheses at the lowest depth open an outermost pair when the
+    // segment starts at depth -depth_min.
+    int depth_min;
+    int depth_delta;
+    int opens_at_min;
+
+    // Depth and outermost pairs so far at the start of the segment
+    int depth;
+    int brackets;
+};
+
+struct lex_parallel
+{
+    lex_process_s *process;
+    threadpool_s *pool;
+    struct lex_chunk *chunks;
+    int total_chunks;
+    // Chunks the array has room for
+    int max_chunks;
+
+    // Vector of struct lex_segment in source order
+    vector_s *segments;
+    // Vector of struct lex_chunk*, the chunks we lexed for real after a wrong guess
+    vector_s *relexed;
+
+    // An error of the file jumps here, the file is lexed again serially to
+    // report it along with the rest of its errors
+    jmp_buf *serial_jmp;
+};
+
+static const char *lex_chunk_fill(lex_process_s *process, size_t offset, size_t *size)
+{
+    lex_process_s *parent = lex_process_private(process);
+    *size = offset < parent->source_size ? parent->source_size - offset : 0;
+    return parent->source + offset;
+}
+
+static const char *lex_chunk_source(lex_process_s *process, size_t *size)
+{
+    lex_process_s *parent = lex_process_private(process);
+    if (!parent)
+    {
+        return NULL;
+    }
+
+    *size = parent->source_size;
+    return parent->source;
+}
+
+static lex_process_functions_s lex_chunk_functions =
+{
+    .fill = lex_chunk_fill,
+    .source = lex_chunk_source
+};
+
+static int lex_parallel_count_lines(const char *data, size_t size)
+{
+    int lines = 0;
+    const char *end = data + size;
+    for (const char *c = memchr(data, '\n', size); c; c = memchr(c + 1, '\n', end - c - 1))
+    {
+        lines++;
+    }
+    return lines;
+}
+
+static void lex_chunk_run(void *arg)
+{
+    struct lex_chunk *chunk = arg;
+    lex_process_s *lex_process = chunk->lex_process;
+    lex_process_s *parent = lex_process_private(lex_process);
+    chunk->lines = lex_parallel_count_lines(parent->source + chunk->start, chunk->end - chunk->start);
+
+    if (setjmp(chunk->error_jmp))
+    {
+        // Most likely the chunk started inside a comment or string,
+        // if not the error is reported again when it is lexed for real
+        chunk->failed = true;
+        return;
+    }
+
+    lex_start(lex_process, chunk->start);
+    token_s *token = lex_next(lex_process);
+    chunk->first = token ? token->slice.offset : lex_process->offset;
+    while (token != NULL && token->slice.offset < chunk->end)
+    {
+        vector_push(lex_process->token_vec, token);
+        token = lex_next(lex_process);
+    }
+    chunk->resume = token ? token->slice.offset : lex_process->offset;
+}
+
+static void lex_parallel_split(struct lex_parallel *parallel, int total_threads)
+{
+    lex_process_s *process = parallel->process;
+    size_t size = process->source_size;
+    int total_chunks = total_threads * LEX_PARALLEL_CHUNKS_PER_THREAD;
+    if (size / total_chunks < LEX_PARALLEL_MIN_CHUNK_SIZE)
+    {
+        total_chunks = size / LEX_PARALLEL_MIN_CHUNK_SIZE;
+    }
+    if (total_chunks < 1)
+    {
+        total_chunks = 1;
+    }
+
+    parallel->chunks = allocator_calloc(process->allocator, total_chunks * sizeof(struct lex_chunk));
+    parallel->max_chunks = total_chunks;
+    parallel->total_chunks = 0;
+    size_t start = 0;
+    for (int i = 1; i <= total_chunks && start < size; i++)
+    {
+        // Move the boundary up to just past the next newline
+        size_t end = size;
+        if (i < total_chunks)
+        {
+            size_t guess = size / total_chunks * i;
+            const char *newline = guess < start ? NULL : memchr(process->source + guess, '\n', size - guess);
+            end = newline ? (size_t)(newline - process->source) + 1 : size;
+        }
+
+        if (end <= start)
+        {
+            continue;
+        }
+
+        struct lex_chunk *chunk = &parallel->chunks[parallel->total_chunks++];
+        chunk->start = start;
+        chunk->end = end;
+        start = end;
+    }
+}
+
+static void lex_parallel_create_chunk(struct lex_parallel *parallel, struct lex_chunk *chunk, bool speculative)
+{
+    lex_process_s *process = parallel->process;
+    chunk->compiler = *process->compiler;
+    chunk->compiler.interns = intern_pool_create_allocator(process->allocator);
+    // Errors of a wrong guess are not errors of the file, and those of the
+    // file are reported by the serial lexer
+    chunk->compiler.diagnostics = NULL;
+    chunk->compiler.failure_jmp = NULL;
+    chunk->compiler.error_jmp = speculative ? &chunk->error_jmp : parallel->serial_jmp;
+
+    chunk->lex_process = lex_process_create(&chunk->compiler, &lex_chunk_functions, process);
+    chunk->lex_process->defer_brackets = true;
+    vector_reserve(chunk->lex_process->token_vec, (chunk->end - chunk->start) / LEX_PROCESS_BYTES_PER_TOKEN);
+}
+
+// Size of the per intern id arrays of a chunk
+static size_t lex_chunk_ids_size(struct lex_chunk *chunk)
+{
+    return (intern_pool_count(chunk->compiler.interns) + 1) * sizeof(unsigned int);
+}
+
+static void lex_parallel_free_chunk(struct lex_chunk *chunk)
+{
+    allocator_s *allocator = chunk->lex_process->allocator;
+    allocator_free(allocator, chunk->first_use, lex_chunk_ids_size(chunk));
+    allocator_free(allocator, chunk->sids, lex_chunk_ids_size(chunk));
+    lex_process_free(chunk->lex_process);
+    intern_pool_free(chunk->compiler.interns);
+}
+
+static void lex_parallel_add_segment(struct lex_parallel *parallel, struct lex_chunk *chunk, int first_token)
+{
+    struct lex_segment segment = {.chunk = chunk, .first_token = first_token};
+    segment.total_tokens = vector_count(chunk->lex_process->token_vec) - first_token;
+    vector_push(parallel->segments, &segment);
+}
+
+static int lex_parallel_chunk_at(struct lex_parallel *parallel, size_t offset)
+{
+    int low = 0;
+    int high = parallel->total_chunks - 1;
+    while (low < high)
+    {
+        int middle = (low + high + 1) / 2;
+        if (parallel->chunks[middle].start <= offset)
+        {
+            low = middle;
+        }
+        else
+        {
+            high = middle - 1;
+        }
+    }
+    return low;
+}
+
+// Index of the chunk token starting at offset, -1 if no token starts there
+static int lex_parallel_chunk_token_at(struct lex_chunk *chunk, size_t offset)
+{
+    vector_s *tokens = chunk->lex_process->token_vec;
+    int low = 0;
+    int high = vector_count(tokens) - 1;
+    while (low <= high)
+    {
+        int middle = (low + high) / 2;
+        token_s *token = vector_at(tokens, middle);
+        if (token->slice.offset == offset)
+        {
+            return middle;
+        }
+        else if (token->slice.offset < offset)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle - 1;
+        }
+    }
+    return -1;
+}
+
+// The position the lexer is at after reading everything before offset
+static pos_s lex_parallel_pos_at(struct lex_parallel *parallel, size_t offset)
+{
+    struct lex_chunk *chunk = &parallel->chunks[lex_parallel_chunk_at(parallel, offset)];
+    pos_s pos = parallel->process->pos;
+    pos.line = chunk->lines_before + 1;
+    pos.col = 1;
+    for (size_t i = chunk->start; i < offset; i++)
+    {
+        pos.col += 1;
+        if (parallel->process->source[i] == '\n')
+        {
+            pos.line += 1;
+            pos.col = 1;
+        }
+    }
+    return pos;
+}
+
+// The compiler counts lines and columns from zero where the lexer counts from one
+static pos_s lex_parallel_compiler_pos(pos_s pos)
+{
+    pos.line -= 1;
+    pos.col -= 1;
+    return pos;
+}
+
+/**
+ * Lexes for real from offset, where the previous chunk ended up but the next
+ * chunk did not start. Stops as soon as we produce a newline that a chunk
+ * lexer also produced, from there on that chunk lexed the same tokens.
+ * Returns the chunk after the one we lined up with, total_chunks if we lexed
+ * to the end.
+ */
+static int lex_parallel_relex(struct lex_parallel *parallel, size_t offset, size_t *resume)
+{
+    // Offset is the start of a token that follows a newline, comment or
+    // string. None of the tokens before it change how the lexer goes on.
+    struct lex_chunk *relexed = allocator_calloc(parallel->process->allocator, sizeof(struct lex_chunk));
+    relexed->start = offset;
+    relexed->end = offset;
+    lex_parallel_create_chunk(parallel, relexed, false);
+    vector_push(parallel->relexed, &relexed);
+
+    lex_process_s *relexer = relexed->lex_process;
+    lex_start(relexer, offset);
+    relexer->pos = lex_parallel_pos_at(parallel, offset);
+    relexed->compiler.pos = lex_parallel_compiler_pos(relexer->pos);
+
+    *resume = parallel->process->source_size;
+    for (token_s *token = lex_next(relexer); token; token = lex_next(relexer))
+    {
+        if (token->type == TOKEN_TYPE_NEWLINE)
+        {
+            int index = lex_parallel_chunk_at(parallel, token->slice.offset);
+            struct lex_chunk *chunk = &parallel->chunks[index];
+            int token_index = chunk->failed ? -1 : lex_parallel_chunk_token_at(chunk, token->slice.offset);
+            if (token_index >= 0)
+            {
+                // The chunk has the same newline along with everything after it
+                lex_parallel_add_segment(parallel, relexed, 0);
+                lex_parallel_add_segment(parallel, chunk, token_index);
+                *resume = chunk->resume;
+                return index + 1;
+            }
+        }
+        vector_push(relexer->token_vec, token);
+    }
+
+    lex_parallel_add_segment(parallel, relexed, 0);
+    return parallel->total_chunks;
+}
+
+/**
+ * Walks the chunks in order, a chunk is right when the previous one stopped
+ * exactly where it found its first token. Otherwise we lex for real until
+ * we line up with one of the chunks again.
+ */
+static void lex_parallel_validate(struct lex_parallel *parallel)
+{
+    size_t resume = 0;
+    int index = 0;
+    while (index < parallel->total_chunks)
+    {
+        struct lex_chunk *chunk = &parallel->chunks[index];
+        if (resume >= chunk->end)
+        {
+            // A comment or string ran over this whole chunk
+            index++;
+            continue;
+        }
+
+        if (!chunk->failed && (index == 0 || resume == chunk->first))
+        {
+            lex_parallel_add_segment(parallel, chunk, 0);
+            resume = chunk->resume;
+            index++;
+            continue;
+        }
+
+        index = lex_parallel_relex(parallel, resume, &resume);
+    }
+}
+
+static bool lex_parallel_token_is_interned(token_s *token)
+{
+    return token->type == TOKEN_TYPE_IDENTIFIER ||
+           token->type == TOKEN_TYPE_KEYWORD ||
+           token->type == TOKEN_TYPE_STRING;
+}
+
+static bool lex_parallel_token_is_left_paren(token_s *token)
+{
+    return token->type == TOKEN_TYPE_OPERATOR && token->op == OPERATOR_LEFT_PAREN;
+}
+
+static bool lex_parallel_token_is_right_paren(token_s *token)
+{
+    return token->type == TOKEN_TYPE_SYMBOL && token->cval == ')';
+}
+
+// Finds the interned strings the segment uses and how its parentheses nest
+static void lex_segment_scan(void *arg)
+{
+    struct lex_segment *segment = arg;
+    struct lex_chunk *chunk = segment->chunk;
+    vector_s *tokens = chunk->lex_process->token_vec;
+    chunk->first_use = allocator_calloc(chunk->lex_process->allocator, lex_chunk_ids_size(chunk));
+
+    int depth = 0;
+    for (int i = 0; i < segment->total_tokens; i++)
+    {
+        token_s *token = vector_at(tokens, segment->first_token + i);
+        if (lex_parallel_token_is_interned(token))
+        {
+            if (!chunk->first_use[token->sid])
+            {
+                chunk->first_use[token->sid] = i + 1;
+            }
+        }
+        else if (lex_parallel_token_is_right_paren(token))
+        {
+            depth--;
+            if (depth < segment->depth_min)
+            {
+                segment->depth_min = depth;
+                segment->opens_at_min = 0;
+            }
+        }
+        else if (lex_parallel_token_is_left_paren(token))
+        {
+            segment->opens_at_min += depth == segment->depth_min;
+            depth++;
+        }
+    }
+    segment->depth_delta = depth;
+}
+
+struct lex_first_use
+{
+    unsigned int first_use;
+    unsigned int sid;
+};
+
+static int lex_first_use_compare(const void *a, const void *b)
+{
+    const struct lex_first_use *first = a;
+    const struct lex_first_use *second = b;
+    return (int)first->first_use - (int)second->first_use;
+}
+
+/**
+ * Interns the strings of a segment into the real pool in the order they are
+ * first used, so the ids come out exactly as a serial lex gives them
+ */
+static void lex_parallel_intern_segment(struct lex_parallel *parallel, struct lex_segment *segment)
+{
+    struct lex_chunk *chunk = segment->chunk;
+    intern_pool_s *chunk_interns = chunk->compiler.interns;
+    size_t total = intern_pool_count(chunk_interns);
+    allocator_s *allocator = parallel->process->allocator;
+    chunk->sids = allocator_calloc(allocator, lex_chunk_ids_size(chunk));
+
+    struct lex_first_use *used = allocator_alloc(allocator, sizeof(struct lex_first_use) * (total + 1));
+    size_t total_used = 0;
+    for (size_t sid = 0; sid < total; sid++)
+    {
+        if (chunk->first_use[sid])
+        {
+            used[total_used++] = (struct lex_first_use){.first_use = chunk->first_use[sid], .sid = sid};
+        }
+    }
+
+    // The chunk pool is in order of first use already, unless the segment
+    // starts past the first token of the chunk
+    if (segment->first_token > 0)
+    {
+        qsort(used, total_used, sizeof(struct lex_first_use), lex_first_use_compare);
+    }
+
+    intern_pool_s *interns = parallel->process->compiler->interns;
+    for (size_t i = 0; i < total_used; i++)
+    {
+        unsigned int sid = used[i].sid;
+        const char *str = intern_pool_str(chunk_interns, sid);
+        chunk->sids[sid] = intern_pool_intern(interns, str, intern_pool_len(chunk_interns, sid));
+    }
+    allocator_free(allocator, used, sizeof(struct lex_first_use) * (total + 1));
+}
+
+/**
+ * Copies the tokens of a segment to their place in the final token vector,
+ * moving them to the real line numbers and intern ids and filling in the
+ * parentheses the chunk lexer left out
+ */
+static void lex_segment_copy(void *arg)
+{
+    struct lex_segment *segment = arg;
+    struct lex_chunk *chunk = segment->chunk;
+    lex_process_s *process = lex_process_private(chunk->lex_process);
+    intern_pool_s *interns = process->compiler->interns;
+    vector_s *tokens = chunk->lex_process->token_vec;
+
+    int depth = segment->depth;
+    int brackets = segment->brackets;
+    for (int i = 0; i < segment->total_tokens; i++)
+    {
+        token_s *token = vector_at(process->token_vec, segment->output + i);
+        *token = *(token_s *)vector_at(tokens, segment->first_token + i);
+        token->pos.line += chunk->lines_before;
+        if (lex_parallel_token_is_interned(token))
+        {
+            token->sid = chunk->sids[token->sid];
+            token->sval = intern_pool_str(interns, token->sid);
+        }
+
+        // A ')' leaves the expression before its token is made and a '('
+        // enters it after, as in the serial lexer
+        if (lex_parallel_token_is_right_paren(token) && --depth == 0)
+        {
+            lex_brackets_s *pair = vector_at(process->brackets, brackets - 1);
+            pair->end = token->slice.offset;
+        }
+
+        token->between_brackets = depth > 0 ? brackets : 0;
+        if (lex_parallel_token_is_left_paren(token) && ++depth == 1)
+        {
+            lex_brackets_s *pair = vector_at(process->brackets, brackets++);
+            pair->start = token->slice.offset + 1;
+        }
+    }
+}
+
+static void lex_parallel_run_segments(struct lex_parallel *parallel, THREADPOOL_JOB_FUNCTION function)
+{
+    struct threadpool_group group = {0};
+    for (int i = 0; i < vector_count(parallel->segments); i++)
+    {
+        threadpool_submit(parallel->pool, &group, function, vector_at(parallel->segments, i));
+    }
+    threadpool_wait(parallel->pool, &group);
+}
+
+/**
+ * Puts the segments together into the token vector. Only the parts that
+ * depend on everything before them run in order, once per segment rather
+ * than once per token.
+ */
+static void lex_parallel_stitch(struct lex_parallel *parallel)
+{
+    lex_process_s *process = parallel->process;
+    lex_parallel_run_segments(parallel, lex_segment_scan);
+
+    int output = 0;
+    int depth = 0;
+    int brackets = 0;
+    for (int i = 0; i < vector_count(parallel->segments); i++)
+    {
+        struct lex_segment *segment = vector_at(parallel->segments, i);
+        segment->output = output;
+        segment->depth = depth;
+        segment->brackets = brackets;
+        if (depth + segment->depth_min < 0)
+        {
+            // A right parenthesis closes more than was opened
+            longjmp(*parallel->serial_jmp, 1);
+        }
+
+        if (depth + segment->depth_min == 0)
+        {
+            brackets += segment->opens_at_min;
+        }
+        depth += segment->depth_delta;
+        output += segment->total_tokens;
+        lex_parallel_intern_segment(parallel, segment);
+    }
+
+    vector_stretch(process->token_vec, output);
+    vector_stretch(process->brackets, brackets);
+    // Pairs that are never closed end where lexing stopped
+    memset(vector_at(process->brackets, 0), 0, sizeof(lex_brackets_s) * brackets);
+    lex_parallel_run_segments(parallel, lex_segment_copy);
+    process->current_expression_count = depth;
+}
+
+static void lex_parallel_free(struct lex_parallel *parallel)
+{
+    lex_process_s *process = parallel->process;
+    for (int i = 0; i < parallel->total_chunks; i++)
+    {
+        lex_parallel_free_chunk(&parallel->chunks[i]);
+    }
+    for (int i = 0; i < vector_count(parallel->relexed); i++)
+    {
+        struct lex_chunk *relexed = *(struct lex_chunk **)vector_at(parallel->relexed, i);
+        lex_parallel_free_chunk(relexed);
+        allocator_free(process->allocator, relexed, sizeof(struct lex_chunk));
+    }
+    allocator_free(process->allocator, parallel->chunks, parallel->max_chunks * sizeof(struct lex_chunk));
+    vector_free(parallel->segments);
+    vector_free(parallel->relexed);
+}
+
+int lex_parallel(lex_process_s *process, threadpool_s *pool)
+{
+    lex_start(process, 0);
+    int total_threads = pool ? threadpool_total_threads(pool) : 1;
+    if (!process->source || total_threads < 2 || process->source_size < 2 * LEX_PARALLEL_MIN_CHUNK_SIZE)
+    {
+        return lex(process);
+    }
+
+    struct lex_parallel parallel = {.process = process, .pool = pool};
+    parallel.segments = vector_create_allocator(sizeof(struct lex_segment), process->allocator);
+    parallel.relexed = vector_create_allocator(sizeof(struct lex_chunk *), process->allocator);
+    lex_parallel_split(&parallel, total_threads);
+
+    struct threadpool_group group = {0};
+    for (int i = 0; i < parallel.total_chunks; i++)
+    {
+        lex_parallel_create_chunk(&parallel, &parallel.chunks[i], true);
+        threadpool_submit(pool, &group, lex_chunk_run, &parallel.chunks[i]);
+    }
+    threadpool_wait(pool, &group);
+
+    // Errors of the file are found from here on
+    jmp_buf serial_jmp;
+    parallel.serial_jmp = &serial_jmp;
+    if (setjmp(serial_jmp))
+    {
+        // Nothing reached the token vector yet and the real intern pool
+        // holds what the serial lexer interns first, in the same order
+        lex_parallel_free(&parallel);
+        return lex(process);
+    }
+
+    for (int i = 1; i < parallel.total_chunks; i++)
+    {
+        struct lex_chunk *previous = &parallel.chunks[i - 1];
+        parallel.chunks[i].lines_before = previous->lines_before + previous->lines;
+    }
+
+    lex_parallel_validate(&parallel);
+    lex_parallel_stitch(&parallel);
+    process->offset = process->source_size;
+    lex_parallel_free(&parallel);
+    return LEXICAL_ANALYSIS_ALL_OK;
+}
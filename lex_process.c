@@ -1,14 +1,21 @@
 #include "compiler.h"
 #include "helpers/vector.h"
+#include "helpers/arena.h"
+#include "helpers/allocator.h"
 #include <stdlib.h>
 
 lex_process_s *lex_process_create(compile_process_s *compiler, lex_process_functions_s *functions, void *private)
 {
-    lex_process_s *process = calloc(1, sizeof(lex_process_s));
+    allocator_s *allocator = allocator_or_default(compiler->allocator);
+    lex_process_s *process = allocator_calloc(allocator, sizeof(lex_process_s));
+    process->allocator = allocator;
     process->function = functions;
-    process->token_vec = vector_create(sizeof(token_s));
+    process->token_vec = vector_create_allocator(sizeof(token_s), allocator);
+    process->brackets = vector_create_allocator(sizeof(lex_brackets_s), allocator);
     process->compiler = compiler;
     process->private = private;
+    process->arena = arena_create_allocator(ARENA_DEFAULT_BLOCK_SIZE, allocator);
+
     process->pos.line = 1;
     process->pos.col = 1;
     return process;
@@ -17,7 +24,10 @@ lex_process_s *lex_process_create(compile_process_s *compiler, lex_process_funct
 void lex_process_free(lex_process_s *process)
 {
     vector_free(process->token_vec);
-    free(process);
+    vector_free(process->brackets);
+    arena_free(process->arena);
+    allocator_free(process->allocator, process->adapter_window, LEX_PROCESS_WINDOW_SIZE);
+    allocator_free(process->allocator, process, sizeof(lex_process_s));
 }
 
 void *lex_process_private(lex_process_s *process)
@@ -25,7 +35,89 @@ void *lex_process_private(lex_process_s *process)
     return process->private;
 }
 
+// Reads a window ahead through the character callbacks of inputs without fill
+static const char *lex_process_adapter_fill(lex_process_s *process, size_t *size)
+{
+    if (!process->adapter_window)
+    {
+        process->adapter_window = allocator_alloc(process->allocator, LEX_PROCESS_WINDOW_SIZE);
+    }
+
+    // Callbacks that move the compiler position would run ahead of the lexer,
+    // which keeps the position itself
+    pos_s pos = process->compiler->pos;
+    size_t total = 0;
+    while (total < LEX_PROCESS_WINDOW_SIZE && process->function->peek_char(process) != EOF)
+    {
+        process->adapter_window[total++] = process->function->next_char(process);
+    }
+    process->compiler->pos = pos;
+
+    *size = total;
+    return process->adapter_window;
+}
+
+const char *lex_process_fill(lex_process_s *process, size_t offset, size_t *size)
+{
+    *size = 0;
+    if (process->function->fill)
+    {
+        return process->function->fill(process, offset, size);
+    }
+
+    // The adapter can only go on from where it stopped, which is all the
+    // lexer ever asks for
+    return lex_process_adapter_fill(process, size);
+}
+
 vector_s *lex_process_tokens(lex_process_s *process)
 {
     return process->token_vec;
 }
+
+const char *lex_process_token_text(lex_process_s *process, token_s *token, size_t *len)
+{
+    bool has_sval = token->type == TOKEN_TYPE_IDENTIFIER ||
+                    token->type == TOKEN_TYPE_KEYWORD ||
+                    token->type == TOKEN_TYPE_OPERATOR ||
+                    token->type == TOKEN_TYPE_STRING ||
+                    token->type == TOKEN_TYPE_COMMENT;
+    if (has_sval && !(token->flags & TOKEN_FLAG_SOURCE_SLICE))
+    {
+        *len = strlen(token->sval);
+        return token->sval;
+    }
+
+    if (!process->source)
+    {
+        // Numbers and symbols only have text in a contiguous source
+        *len = 0;
+        return NULL;
+    }
+
+    const char *text = process->source + token->slice.offset;
+    *len = token->slice.length;
+    if (token->type == TOKEN_TYPE_COMMENT)
+    {
+        // Strip the "//" or the "/*" and "*/" delimiters
+        bool multi_line = text[1] == '*';
+        text += 2;
+        *len -= multi_line ? 4 : 2;
+    }
+    return text;
+}
+
+const char *lex_process_between_brackets(lex_process_s *process, token_s *token, size_t *len)
+{
+    *len = 0;
+    if (!token->between_brackets || !process->source)
+    {
+        return NULL;
+    }
+
+    lex_brackets_s *brackets = vector_at(process->brackets, token->between_brackets - 1);
+    // Parentheses that were never closed run up to where lexing stopped
+    unsigned int end = brackets->end ? brackets->end : process->offset;
+    *len = end - brackets->start;
+    return process->source + brackets->start;
+}
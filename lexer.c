@@ -1,495 +1,782 @@
 #include "compiler.h"
 #include "helpers/vector.h"
 #include "helpers/buffer.h"
+#include "helpers/intern.h"
+#include "helpers/arena.h"
+#include "lexer_tables.h"
 #include <string.h>
 #include <assert.h>
 #include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+
+// Longest floating constant the lexer converts, its text is copied to the stack
+#define LEXER_NUMBER_MAX_LENGTH 512
+
+// The buffer may be NULL when the text is taken as a slice of the source.
+// Expects the lex_process being read from to be in scope.
+#define LEX_GETC_IF(buffer, c, exp)                                   \
+    for (c = peekc(lex_process); exp; c = peekc(lex_process))         \
+    {                                                                 \
+        if (buffer)                                                   \
+        {                                                             \
+            buffer_write(buffer, c);                                  \
+        }                                                             \
+        nextc(lex_process);                                           \
+    }
+
+token_s *read_next_token(lex_process_s *lex_process);
+token_s *token_make_identifier_or_keyword(lex_process_s *lex_process);
+static bool _lex_is_in_expression(lex_process_s *lex_process);
 
-#define LEX_GETC_IF(buffer, c, exp)     \
-    for (c = peekc(); exp; c = peekc()) \
-    {                                   \
-        buffer_write(buffer, c);        \
-        nextc();                        \
+// Moves the window on to the input at the current offset, false at the end
+static bool lexer_fill(lex_process_s *lex_process)
+{
+    if (lex_process->source)
+    {
+        // The window already is the whole source
+        return false;
     }
 
-static lex_process_s *lex_process;
-static token_s tmp_token;
+    // Inputs read through a window can't go back, keep what lexer_unread may need
+    if (lex_process->window_size)
+    {
+        lex_process->window_previous = lex_process->window[lex_process->window_size - 1];
+    }
 
-token_s *read_next_token();
-token_s *token_make_identifier_or_keyword();
-static bool _lex_is_in_expression();
+    size_t size = 0;
+    const char *window = lex_process_fill(lex_process, lex_process->offset, &size);
+    lex_process->window = window;
+    lex_process->window_offset = lex_process->offset;
+    lex_process->window_size = window ? size : 0;
+    return lex_process->window_size > 0;
+}
 
-static char peekc()
+static char peekc(lex_process_s *lex_process)
 {
-    return lex_process->function->peek_char(lex_process);
+    size_t index = lex_process->offset - lex_process->window_offset;
+    if (index >= lex_process->window_size)
+    {
+        if (lex_process->offset + 1 == lex_process->window_offset)
+        {
+            return lex_process->window_previous;
+        }
+
+        if (!lexer_fill(lex_process))
+        {
+            return EOF;
+        }
+        index = 0;
+    }
+    return lex_process->window[index];
 }
 
-static char nextc()
+static char nextc(lex_process_s *lex_process)
 {
-    char c = lex_process->function->next_char(lex_process);
-    if (_lex_is_in_expression())
+    char c = peekc(lex_process);
+    if (c != EOF)
     {
-        buffer_write(lex_process->parentheses_buffer, c);
+        lex_process->offset++;
     }
+
+    // The compiler position reports errors, it counts from zero
+    compile_process_s *compiler = lex_process->compiler;
+    compiler->pos.col += 1;
     lex_process->pos.col += 1;
     if (c == '\n')
     {
+        compiler->pos.line += 1;
+        compiler->pos.col = 0;
         lex_process->pos.line += 1;
         lex_process->pos.col = 1;
     }
     return c;
 }
 
-static void pushc(char c)
+static size_t lexer_remaining(lex_process_s *lex_process)
+{
+    return lex_process->source_size - lex_process->offset;
+}
+
+// Consumes the next len characters of the source, none of them may be a newline
+static void lexer_skip(lex_process_s *lex_process, size_t len)
+{
+    lex_process->offset += len;
+    lex_process->pos.col += len;
+    lex_process->compiler->pos.col += len;
+}
+
+// Gives back the last len characters consumed, none of them may be a newline.
+// Past the start of the window only one character can be given back.
+static void lexer_unread(lex_process_s *lex_process, size_t len)
 {
-    lex_process->function->push_char(lex_process, c);
+    lex_process->offset -= len;
+    lex_process->pos.col -= len;
+    lex_process->compiler->pos.col -= len;
+}
+
+// Consumes the next len characters of the source, newlines included
+static void lexer_skip_lines(lex_process_s *lex_process, size_t len)
+{
+    const char *start = lex_process->source + lex_process->offset;
+    const char *end = start + len;
+    const char *line_start = NULL;
+    int lines = 0;
+    for (const char *c = memchr(start, '\n', len); c; c = memchr(c + 1, '\n', end - c - 1))
+    {
+        lines++;
+        line_start = c + 1;
+    }
+
+    if (!lines)
+    {
+        lexer_skip(lex_process, len);
+        return;
+    }
+
+    lex_process->offset += len;
+    lex_process->pos.line += lines;
+    lex_process->pos.col = 1 + (end - line_start);
+    lex_process->compiler->pos.line += lines;
+    lex_process->compiler->pos.col = end - line_start;
 }
 
-static char assert_next_char(char c)
+static char assert_next_char(lex_process_s *lex_process, char c)
 {
-    char next_c = nextc();
+    char next_c = nextc(lex_process);
     assert(c == next_c);
     return next_c;
 }
 
-static pos_s _lex_file_position()
+static pos_s _lex_file_position(lex_process_s *lex_process)
 {
     return lex_process->pos;
 }
 
-token_s *token_create(token_s *_token)
+token_s *token_create(lex_process_s *lex_process, token_s *_token)
 {
-    memcpy(&tmp_token, _token, sizeof(token_s));
-    tmp_token.pos = _lex_file_position();
-    if (_lex_is_in_expression())
+    token_s *token = &lex_process->token;
+    memcpy(token, _token, sizeof(token_s));
+    token->pos = _lex_file_position(lex_process);
+    token->slice.offset = lex_process->token_start;
+    token->slice.length = lex_process->offset - lex_process->token_start;
+    if (_lex_is_in_expression(lex_process))
     {
-        tmp_token.between_brackets = buffer_ptr(lex_process->parentheses_buffer);
+        token->between_brackets = vector_count(lex_process->brackets);
     }
-    return &tmp_token;
+    return token;
+}
+
+// Scratch buffers live in the lexer arena and are released with the lex process
+static buffer_s *lexer_buffer_create(lex_process_s *lex_process)
+{
+    return buffer_create_arena(lex_process->arena, BUFFER_ARENA_INITIAL_SIZE);
+}
+
+// Returns the text scanned since start, either collected in buf or,
+// when buf is NULL, the slice of the source it was read from.
+static const char *lexer_text(lex_process_s *lex_process, buffer_s *buf, size_t start, size_t *len)
+{
+    if (buf)
+    {
+        *len = buf->len;
+        return buffer_ptr(buf);
+    }
+
+    *len = lex_process->offset - start;
+    return lex_process->source + start;
 }
 
-token_s *lexer_last_token()
+// Interns the given text, then releases everything allocated in the arena
+// since mark as the intern pool holds its own copy.
+static unsigned int lexer_intern(lex_process_s *lex_process, const char *text, size_t len, arena_mark_s mark, const char **str)
 {
-    return vector_back_or_null(lex_process->token_vec);
+    intern_pool_s *interns = lex_process->compiler->interns;
+    unsigned int sid = intern_pool_intern(interns, text, len);
+    *str = intern_pool_str(interns, sid);
+    arena_rewind(lex_process->arena, mark);
+    return sid;
 }
 
-token_s *handle_whitespace()
+token_s *lexer_last_token(lex_process_s *lex_process)
 {
-    token_s *last_token = lexer_last_token();
+    if (lex_process->lookahead_count == 0)
+    {
+        return NULL;
+    }
+    int last = (lex_process->lookahead_head + lex_process->lookahead_count - 1) % LEX_PROCESS_LOOKAHEAD;
+    return &lex_process->lookahead[last];
+}
+
+token_s *handle_whitespace(lex_process_s *lex_process)
+{
+    token_s *last_token = lexer_last_token(lex_process);
     if (last_token != NULL)
     {
         last_token->whitespace = true;
     }
 
-    nextc();
-    return read_next_token();
+    // Skip the whole run at once rather than one token read per character
+    if (lex_process->source)
+    {
+        lexer_skip(lex_process, scan_whitespace(lex_process->source + lex_process->offset, lexer_remaining(lex_process)));
+    }
+    else
+    {
+        char c = 0x00;
+        LEX_GETC_IF(NULL, c, (c == ' ' || c == '\t'))
+    }
+    return read_next_token(lex_process);
 }
 
-const char *read_number_str()
+// Numeric constant being scanned. The value is accumulated digit by digit,
+// the text is only kept for floating constants and never touches the heap.
+struct lexer_number
 {
-    const char *num = NULL;
-    buffer_s *buffer = buffer_create();
-    char c = peekc();
-    LEX_GETC_IF(buffer, c, (c >= '0' && c <= '9'))
-    buffer_write(buffer, 0x00);
-    return buffer_ptr(buffer);
-}
+    int base;
+    unsigned long long value;
+    bool overflow;
+    bool invalid_digit; ///< A digit too big for the base, 8 or 9 after a leading 0
+    int digits;         ///< Digits after the prefix, the exponent excluded
+
+    bool floating;
+    char text[LEXER_NUMBER_MAX_LENGTH];
+    size_t len;
+};
 
-unsigned long long read_number()
+static void lexer_number_init(struct lexer_number *number)
 {
-    const char *s = read_number_str();
-    return atoll(s);
+    // Everything but the text, zeroing it would cost more than scanning most constants
+    number->base = 10;
+    number->value = 0;
+    number->overflow = false;
+    number->invalid_digit = false;
+    number->digits = 0;
+    number->floating = false;
+    number->len = 0;
 }
 
-token_number_type_e lexer_number_type(char c)
+static void lexer_number_append(struct lexer_number *number, char c)
 {
-    token_number_type_e res = NUMBER_TYPE_NORMAL;
-    c = tolower(c);
-    if (c == 'l')
+    if (number->len < LEXER_NUMBER_MAX_LENGTH - 1)
     {
-        res = NUMBER_TYPE_LONG;
+        number->text[number->len] = c;
     }
-    else if (c == 'f')
+    number->len++;
+}
+
+static int lexer_digit_value(char c)
+{
+    if (c >= '0' && c <= '9')
     {
-        res = NUMBER_TYPE_FLOAT;
+        return c - '0';
     }
-    return res;
+
+    c = tolower((unsigned char)c);
+    return c >= 'a' && c <= 'f' ? c - 'a' + 10 : 16;
 }
 
-token_s *token_make_number_for_value(unsigned long long number)
+static inline void lexer_number_accumulate(struct lexer_number *number, int digit)
 {
-    token_number_type_e number_type = lexer_number_type((peekc()));
-    if (number_type != NUMBER_TYPE_NORMAL)
+    if (digit >= number->base)
     {
-        nextc();
+        number->invalid_digit = true;
+    }
+
+    if (__builtin_mul_overflow(number->value, (unsigned long long)number->base, &number->value) ||
+        __builtin_add_overflow(number->value, (unsigned long long)digit, &number->value))
+    {
+        number->overflow = true;
     }
-    return token_create(&(token_s){.type = TOKEN_TYPE_NUMBER, .llnum = number, .num.type = number_type});
 }
 
-token_s *token_make_number()
+static void lexer_number_push(struct lexer_number *number, char c)
 {
-    return token_make_number_for_value(read_number());
+    lexer_number_append(number, c);
+    number->digits++;
+    if (!number->floating)
+    {
+        lexer_number_accumulate(number, lexer_digit_value(c));
+    }
 }
 
-void lexer_pop_token()
+static void lexer_read_decimal_digits(lex_process_s *lex_process, struct lexer_number *number)
 {
-    vector_pop(lex_process->token_vec);
+    if (lex_process->source)
+    {
+        // Find the run at once and copy it in one go
+        const char *digits = lex_process->source + lex_process->offset;
+        size_t len = scan_digits(digits, lexer_remaining(lex_process));
+        if (number->len + len < LEXER_NUMBER_MAX_LENGTH)
+        {
+            memcpy(number->text + number->len, digits, len);
+        }
+        number->len += len;
+        number->digits += len;
+        if (!number->floating)
+        {
+            // Keep the value in a register, the digits could alias the number
+            unsigned long long value = number->value;
+            bool overflow = false;
+            bool invalid_digit = false;
+            for (size_t i = 0; i < len; i++)
+            {
+                int digit = digits[i] - '0';
+                invalid_digit |= digit >= number->base;
+                overflow |= __builtin_mul_overflow(value, (unsigned long long)number->base, &value);
+                overflow |= __builtin_add_overflow(value, (unsigned long long)digit, &value);
+            }
+            number->value = value;
+            number->overflow |= overflow;
+            number->invalid_digit |= invalid_digit;
+        }
+        lexer_skip(lex_process, len);
+        return;
+    }
+
+    for (char c = peekc(lex_process); c >= '0' && c <= '9'; c = peekc(lex_process))
+    {
+        lexer_number_push(number, nextc(lex_process));
+    }
 }
 
-bool is_hex_char(char c)
+static void lexer_read_hex_digits(lex_process_s *lex_process, struct lexer_number *number)
 {
-    c = tolower(c);
-    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f');
+    for (char c = peekc(lex_process); lexer_digit_value(c) < 16; c = peekc(lex_process))
+    {
+        lexer_number_push(number, nextc(lex_process));
+    }
 }
 
-const char *read_hex_number_str()
+// The sign and digits after an 'e' or 'p', the letter is already read
+static void lexer_read_exponent(lex_process_s *lex_process, struct lexer_number *number)
 {
-    buffer_s *buf = buffer_create();
-    char c = peekc();
-    LEX_GETC_IF(buf, c, is_hex_char(c));
-    // Write our null terminator
-    buffer_write(buf, 0x00);
-    return buffer_ptr(buf);
+    number->floating = true;
+    char c = peekc(lex_process);
+    if (c == '+' || c == '-')
+    {
+        lexer_number_append(number, nextc(lex_process));
+    }
+
+    bool digits = false;
+    for (c = peekc(lex_process); c >= '0' && c <= '9'; c = peekc(lex_process))
+    {
+        lexer_number_append(number, nextc(lex_process));
+        digits = true;
+    }
+
+    if (!digits)
+    {
+        compile_error(lex_process->compiler, "Exponent has no digits\n");
+    }
 }
 
-token_s *token_make_special_number_hexadecimal()
+// The fraction and exponent of a floating constant, if the constant has them
+static void lexer_read_fraction(lex_process_s *lex_process, struct lexer_number *number)
 {
-    // Skip the 'x'
-    nextc();
+    bool hex = number->base == 16;
+    if (peekc(lex_process) == '.')
+    {
+        number->floating = true;
+        lexer_number_append(number, nextc(lex_process));
+        hex ? lexer_read_hex_digits(lex_process, number) : lexer_read_decimal_digits(lex_process, number);
+    }
 
-    unsigned long number = 0;
-    const char *number_str = read_hex_number_str();
-    number = strtoll(number_str, 0, 16);
-    return token_make_number_for_value(number);
+    char exponent = tolower((unsigned char)peekc(lex_process));
+    if (exponent == (hex ? 'p' : 'e'))
+    {
+        lexer_number_append(number, nextc(lex_process));
+        lexer_read_exponent(lex_process, number);
+    }
+    else if (hex && number->floating)
+    {
+        compile_error(lex_process->compiler, "Hexadecimal floating constants need an exponent\n");
+    }
 }
 
-void lexer_validate_binary_string(const char *str)
+/**
+ * Reads the u, l, ll and f suffixes in any valid order into the token,
+ * anything else glued to the constant is an error
+ */
+static void lexer_read_number_suffix(lex_process_s *lex_process, struct lexer_number *number, token_s *token)
 {
-    size_t len = strlen(str);
-    for (size_t i = 0; i < len; i++)
+    bool is_long = false;
+    bool is_unsigned = false;
+    bool is_float = false;
+    for (;;)
     {
-        if (str[i] != '0' && str[i] != '1')
+        char c = peekc(lex_process);
+        char lower = tolower((unsigned char)c);
+        if (lower == 'u' && !is_unsigned && !number->floating)
+        {
+            is_unsigned = true;
+            token->flags |= TOKEN_FLAG_NUMBER_UNSIGNED;
+        }
+        else if (lower == 'l' && !is_long && !is_float)
+        {
+            is_long = true;
+            nextc(lex_process);
+            // "ll" and "LL" but not "lL"
+            if (!number->floating && peekc(lex_process) == c)
+            {
+                token->flags |= TOKEN_FLAG_NUMBER_LONG_LONG;
+            }
+            else
+            {
+                continue;
+            }
+        }
+        else if (lower == 'f' && number->floating && !is_float && !is_long)
         {
-            compile_error(lex_process->compiler, "This is not a valid binary number\n");
+            is_float = true;
+        }
+        else
+        {
+            break;
+        }
+        nextc(lex_process);
+    }
+
+    char c = peekc(lex_process);
+    if (isalnum((unsigned char)c) || c == '_' || c == '.')
+    {
+        compile_error(lex_process->compiler, "Invalid suffix on numeric constant\n");
+    }
+
+    if (number->floating)
+    {
+        token->num.type = is_float ? NUMBER_TYPE_FLOAT : NUMBER_TYPE_DOUBLE;
+        if (is_long)
+        {
+            token->flags |= TOKEN_FLAG_NUMBER_LONG_DOUBLE;
         }
     }
+    else
+    {
+        token->num.type = is_long ? NUMBER_TYPE_LONG : NUMBER_TYPE_NORMAL;
+    }
 }
 
-token_s *token_make_special_number_binary()
+static double lexer_number_float_value(lex_process_s *lex_process, struct lexer_number *number, bool is_float)
 {
-    // Skip the 'b'
-    nextc();
+    if (number->len >= LEXER_NUMBER_MAX_LENGTH)
+    {
+        compile_error(lex_process->compiler, "Floating constant is too long\n");
+    }
 
-    unsigned long number = 0;
-    const char *number_str = read_number_str();
-    lexer_validate_binary_string(number_str);
-    number = strtoll(number_str, 0, 2);
-    return token_make_number_for_value(number);
+    number->text[number->len] = 0x00;
+    errno = 0;
+    // A float constant is rounded to float, not just to double
+    double value = is_float ? strtof(number->text, NULL) : strtod(number->text, NULL);
+    if (errno == ERANGE && isinf(value))
+    {
+        compile_warning(lex_process->compiler, "Floating constant exceeds the range of %s", is_float ? "float" : "double");
+    }
+    return value;
 }
 
-token_s *token_make_special_number()
+/**
+ * Scans a whole numeric constant in one pass: decimal, octal, 0x and 0b
+ * integers and decimal or hexadecimal floating constants, with suffixes.
+ */
+token_s *token_make_number(lex_process_s *lex_process)
 {
-    token_s *token = NULL;
-    token_s *last_token = lexer_last_token();
+    struct lexer_number number;
+    lexer_number_init(&number);
+    if (lex_process->offset > lex_process->token_start)
+    {
+        // The '.' of a constant like .5 was read to get here
+        number.floating = true;
+        lexer_number_append(&number, '.');
+        lexer_read_decimal_digits(lex_process, &number);
+        lexer_read_fraction(lex_process, &number);
+    }
+    else if (peekc(lex_process) == '0')
+    {
+        lexer_number_append(&number, nextc(lex_process));
+        char prefix = tolower((unsigned char)peekc(lex_process));
+        if (prefix == 'x' || prefix == 'b')
+        {
+            lexer_number_append(&number, nextc(lex_process));
+            number.base = prefix == 'x' ? 16 : 2;
+            prefix == 'x' ? lexer_read_hex_digits(lex_process, &number) : lexer_read_decimal_digits(lex_process, &number);
+        }
+        else
+        {
+            // The leading zero makes it octal, unless it turns out to be floating
+            number.base = 8;
+            lexer_read_decimal_digits(lex_process, &number);
+        }
+
+        if (number.base != 2)
+        {
+            lexer_read_fraction(lex_process, &number);
+        }
 
-    // Such as "x50", it's not a special number.
-    if (NULL == last_token || !(last_token->type == TOKEN_TYPE_NUMBER && last_token->llnum == 0))
+        if (number.base != 8 && number.digits == 0)
+        {
+            compile_error(lex_process->compiler, "The constant %s has no digits\n", number.base == 16 ? "0x" : "0b");
+        }
+    }
+    else
     {
-        return token_make_identifier_or_keyword();
+        lexer_read_decimal_digits(lex_process, &number);
+        lexer_read_fraction(lex_process, &number);
     }
 
-    lexer_pop_token();
+    token_s token = {.type = TOKEN_TYPE_NUMBER};
+    lexer_read_number_suffix(lex_process, &number, &token);
+    if (number.floating)
+    {
+        token.dnum = lexer_number_float_value(lex_process, &number, token.num.type == NUMBER_TYPE_FLOAT);
+        return token_create(lex_process, &token);
+    }
 
-    char c = peekc();
-    if (c == 'x')
+    if (number.invalid_digit)
     {
-        token = token_make_special_number_hexadecimal();
+        compile_error(lex_process->compiler, "This is not a valid %s number\n", number.base == 2 ? "binary" : "octal");
     }
-    else if (c == 'b')
+    if (number.overflow)
     {
-        token = token_make_special_number_binary();
+        compile_error(lex_process->compiler, "Integer constant is too large\n");
     }
 
-    return token;
+    token.llnum = number.value;
+    return token_create(lex_process, &token);
 }
 
-token_s *token_make_string(char start_delim, char end_delim)
+token_s *token_make_string(lex_process_s *lex_process, char start_delim, char end_delim)
 {
-    buffer_s *buf = buffer_create();
-    assert(nextc() == start_delim);
-    char c = nextc();
-    for (; c != end_delim && c != EOF; c = nextc())
+    arena_mark_s mark = arena_mark(lex_process->arena);
+    assert(nextc(lex_process) == start_delim);
+    size_t start = lex_process->offset;
+
+    // Strings without escapes are interned straight from the source,
+    // the text is only copied out once we find an escape.
+    buffer_s *buf = lex_process->source ? NULL : lexer_buffer_create(lex_process);
+    char c = nextc(lex_process);
+    for (; c != end_delim && c != EOF; c = nextc(lex_process))
     {
         if (c == '\\')
         {
             // We need to handle an escape character.
+            if (!buf)
+            {
+                buf = lexer_buffer_create(lex_process);
+                buffer_write_bytes(buf, lex_process->source + start, lex_process->offset - 1 - start);
+            }
             continue;
         }
 
-        buffer_write(buf, c);
-    }
-
-    buffer_write(buf, 0x00);
-    return token_create(&(token_s){.type = TOKEN_TYPE_STRING, .sval = buffer_ptr(buf)});
-}
-
-static bool _op_treated_as_one(char op)
-{
-    return op == '(' ||
-           op == '[' ||
-           op == ',' ||
-           op == '.' ||
-           op == '*' ||
-           op == '?';
-}
-
-static bool _is_single_operator(char op)
-{
-    return op == '+' ||
-           op == '-' ||
-           op == '/' ||
-           op == '*' ||
-           op == '=' ||
-           op == '>' ||
-           op == '<' ||
-           op == '|' ||
-           op == '&' ||
-           op == '^' ||
-           op == '%' ||
-           op == '!' ||
-           op == '(' ||
-           op == '[' ||
-           op == ',' ||
-           op == '.' ||
-           op == '~' ||
-           op == '?';
-}
-
-bool op_valid(const char *op)
-{
-    return S_EQ(op, "+") ||
-           S_EQ(op, "-") ||
-           S_EQ(op, "*") ||
-           S_EQ(op, "/") ||
-           S_EQ(op, "!") ||
-           S_EQ(op, "^") ||
-           S_EQ(op, "+=") ||
-           S_EQ(op, "-=") ||
-           S_EQ(op, "*=") ||
-           S_EQ(op, "/=") ||
-           S_EQ(op, ">>") ||
-           S_EQ(op, "<<") ||
-           S_EQ(op, ">=") ||
-           S_EQ(op, "<=") ||
-           S_EQ(op, ">") ||
-           S_EQ(op, "<") ||
-           S_EQ(op, "||") ||
-           S_EQ(op, "&&") ||
-           S_EQ(op, "|") ||
-           S_EQ(op, "&") ||
-           S_EQ(op, "++") ||
-           S_EQ(op, "--") ||
-           S_EQ(op, "=") ||
-           S_EQ(op, "!=") ||
-           S_EQ(op, "==") ||
-           S_EQ(op, "->") ||
-           S_EQ(op, "(") ||
-           S_EQ(op, "[") ||
-           S_EQ(op, ",") ||
-           S_EQ(op, ".") ||
-           S_EQ(op, "...") ||
-           S_EQ(op, "~") ||
-           S_EQ(op, "?") ||
-           S_EQ(op, "%");
-}
-
-void read_op_flush_back_but_keep_first(buffer_s *buf)
-{
-    const char *data = buffer_ptr(buf);
-    int len = buf->len;
-    for (int i = len - 1; i >= 1; i--)
-    {
-        if (data[i] == 0x00)
+        if (buf)
         {
-            continue;
+            buffer_write(buf, c);
         }
+    }
 
-        pushc(data[i]);
+    size_t len = 0;
+    const char *text = lexer_text(lex_process, buf, start, &len);
+    if (!buf && c == end_delim)
+    {
+        // Don't include the closing delimiter of the slice
+        len--;
     }
+
+    const char *str = NULL;
+    unsigned int sid = lexer_intern(lex_process, text, len, mark, &str);
+    return token_create(lex_process, &(token_s){.type = TOKEN_TYPE_STRING, .sval = str, .sid = sid});
 }
 
-const char *read_op()
+operator_e read_op(lex_process_s *lex_process, char first)
 {
-    bool single_operator = true;
-    char op = nextc();
-    buffer_s *buf = buffer_create();
-    buffer_write(buf, op);
-
-    if (!_op_treated_as_one(op))
+    // Maximal munch, keep extending the operator while the DFA allows it
+    int state = operator_transition(OPERATOR_NONE, first);
+    for (int next = operator_transition(state, peekc(lex_process)); next != OPERATOR_NONE; next = operator_transition(state, peekc(lex_process)))
     {
-        op = peekc();
-        if (_is_single_operator(op))
-        {
-            buffer_write(buf, op);
-            nextc();
-            single_operator = false;
-        }
+        nextc(lex_process);
+        state = next;
     }
 
-    // NULL terminator
-    buffer_write(buf, 0x00);
-    char *ptr = buffer_ptr(buf);
-    if (!single_operator)
+    if (!operator_state_is_accepting(state))
     {
-        if (!op_valid(ptr))
-        {
-            read_op_flush_back_but_keep_first(buf);
-            ptr[1] = 0x00;
-        }
+        // The characters past the operator we back off to start the next token
+        size_t give_back = 0;
+        state = operator_state_fallback(state, &give_back);
+        lexer_unread(lex_process, give_back);
     }
-    else if (!op_valid(ptr))
+
+    if (state == OPERATOR_NONE)
     {
-        compile_error(lex_process->compiler, "The operator %s is not valid\n", ptr);
+        compile_error(lex_process->compiler, "The operator starting with %c is not valid\n", first);
     }
 
-    return ptr;
+    return state;
 }
 
-static void _lex_new_expression()
+static void _lex_new_expression(lex_process_s *lex_process)
 {
+    if (lex_process->defer_brackets)
+    {
+        return;
+    }
+
     lex_process->current_expression_count++;
     if (lex_process->current_expression_count == 1)
     {
-        lex_process->parentheses_buffer = buffer_create();
+        // The '(' is already consumed, the expression starts right after it
+        lex_brackets_s brackets = {.start = lex_process->offset, .end = 0};
+        vector_push(lex_process->brackets, &brackets);
     }
 }
 
-static void _lex_finish_expression()
+static void _lex_finish_expression(lex_process_s *lex_process)
 {
+    if (lex_process->defer_brackets)
+    {
+        return;
+    }
+
     lex_process->current_expression_count--;
     if (lex_process->current_expression_count < 0)
     {
         compile_error(lex_process->compiler, "You closed an expression that you never opened\n");
     }
+
+    if (lex_process->current_expression_count == 0)
+    {
+        // The ')' is already consumed, the expression ends right before it
+        lex_brackets_s *brackets = vector_back(lex_process->brackets);
+        brackets->end = lex_process->offset - 1;
+    }
 }
 
-static bool _lex_is_in_expression()
+static bool _lex_is_in_expression(lex_process_s *lex_process)
 {
     return lex_process->current_expression_count > 0;
 }
 
-token_s *token_make_operator_or_string()
+token_s *token_make_operator(lex_process_s *lex_process, char first)
 {
-    char op = peekc();
+    operator_e op = read_op(lex_process, first);
+    token_s *token = token_create(lex_process, &(token_s){.type=TOKEN_TYPE_OPERATOR, .sval=operator_name(op), .op=op});
+    if (op == OPERATOR_LEFT_PAREN)
+    {
+        _lex_new_expression(lex_process);
+    }
+
+    return token;
+}
+
+token_s *token_make_operator_or_string(lex_process_s *lex_process)
+{
+    char op = peekc(lex_process);
     if (op == '<')
     {
-        token_s *last_token = lexer_last_token();
-        if (token_is_keyword(last_token, "include"))
+        token_s *last_token = lexer_last_token(lex_process);
+        if (token_is_keyword_id(last_token, KEYWORD_INCLUDE))
         {
-            return token_make_string('<', '>');
+            return token_make_string(lex_process, '<', '>');
         }
     }
 
-    token_s *token = token_create(&(token_s){.type=TOKEN_TYPE_OPERATOR, .sval=read_op()});
-    if (op == '(')
+    return token_make_operator(lex_process, nextc(lex_process));
+}
+
+token_s *token_make_symbol(lex_process_s *lex_process)
+{
+    char c = nextc(lex_process);
+    if (c == ')')
     {
-        _lex_new_expression();
+        _lex_finish_expression(lex_process);
     }
 
-    return token;
+    return token_create(lex_process, &(token_s){.type=TOKEN_TYPE_SYMBOL, .cval=c});
 }
 
-token_s *token_make_symbol()
+token_s *token_make_identifier_or_keyword(lex_process_s *lex_process)
 {
-    char c = nextc();
-    if (c == ')')
+    arena_mark_s mark = arena_mark(lex_process->arena);
+    size_t start = lex_process->offset;
+
+    // With the whole source at hand the identifier is never copied
+    buffer_s *buf = NULL;
+    if (lex_process->source)
     {
-        _lex_finish_expression();
-    }
-
-    token_s *token = token_create(&(token_s){.type=TOKEN_TYPE_SYMBOL, .cval=c});
-}
-
-bool is_keyword(const char *str)
-{
-    return S_EQ(str, "unsigned") ||
-        S_EQ(str, "signed") ||
-        S_EQ(str, "char") ||
-        S_EQ(str, "short") ||
-        S_EQ(str, "int") ||
-        S_EQ(str, "long") ||
-        S_EQ(str, "float") ||
-        S_EQ(str, "double") ||
-        S_EQ(str, "void") ||
-        S_EQ(str, "struct") ||
-        S_EQ(str, "union") ||
-        S_EQ(str, "static") ||
-        S_EQ(str, "__ignore_typecheck") ||
-        S_EQ(str, "return") ||
-        S_EQ(str, "include") ||
-        S_EQ(str, "sizeof") ||
-        S_EQ(str, "if") ||
-        S_EQ(str, "else") ||
-        S_EQ(str, "while") ||
-        S_EQ(str, "for") ||
-        S_EQ(str, "do") ||
-        S_EQ(str, "break") ||
-        S_EQ(str, "continue") ||
-        S_EQ(str, "switch") ||
-        S_EQ(str, "case") ||
-        S_EQ(str, "default") ||
-        S_EQ(str, "goto") ||
-        S_EQ(str, "typedef") ||
-        S_EQ(str, "const") ||
-        S_EQ(str, "extern") ||
-        S_EQ(str, "restrict");
-}
-
-token_s *token_make_identifier_or_keyword()
-{
-    buffer_s *buf = buffer_create();
-    char c = 0x00;
-    LEX_GETC_IF(buf, c, (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || (c == '_'))
+        lexer_skip(lex_process, scan_identifier(lex_process->source + start, lexer_remaining(lex_process)));
+    }
+    else
+    {
+        buf = lexer_buffer_create(lex_process);
+        char c = 0x00;
+        LEX_GETC_IF(buf, c, (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || (c == '_'))
+    }
 
-    // NULL terminator
-    buffer_write(buf, 0x00);
+    size_t len = 0;
+    const char *text = lexer_text(lex_process, buf, start, &len);
 
     // Check if this is a keyword
-    if (is_keyword(buffer_ptr(buf)))
+    keyword_e keyword = keyword_lookup(text, len);
+
+    const char *str = NULL;
+    unsigned int sid = lexer_intern(lex_process, text, len, mark, &str);
+    if (keyword != KEYWORD_NONE)
     {
-        return token_create(&(token_s){.type=TOKEN_TYPE_KEYWORD, .sval=buffer_ptr(buf)});
+        return token_create(lex_process, &(token_s){.type=TOKEN_TYPE_KEYWORD, .sval=str, .sid=sid, .keyword=keyword});
     }
-    return token_create(&(token_s){.type=TOKEN_TYPE_IDENTIFIER, .sval=buffer_ptr(buf)});
+    return token_create(lex_process, &(token_s){.type=TOKEN_TYPE_IDENTIFIER, .sval=str, .sid=sid});
 }
 
-token_s *read_special_token()
+token_s *token_make_newline(lex_process_s *lex_process)
 {
-    char c = peekc();
-    if (isalpha(c) || c == '_')
+    nextc(lex_process);
+    return token_create(lex_process, &(token_s){.type=TOKEN_TYPE_NEWLINE});
+}
+
+// Comments read from a contiguous source are left in it as a slice
+static token_s *token_make_comment(lex_process_s *lex_process, buffer_s *buf)
+{
+    if (!buf)
     {
-        return token_make_identifier_or_keyword();
+        return token_create(lex_process, &(token_s){.type=TOKEN_TYPE_COMMENT, .flags=TOKEN_FLAG_SOURCE_SLICE});
     }
 
-    return NULL;
+    buffer_write(buf, 0x00);
+    return token_create(lex_process, &(token_s){.type=TOKEN_TYPE_COMMENT, .sval=buffer_ptr(buf)});
 }
 
-token_s *token_make_newline()
+token_s *token_make_one_line_comment(lex_process_s *lex_process)
 {
-    nextc();
-    return token_create(&(token_s){.type=TOKEN_TYPE_NEWLINE});
-}
+    if (lex_process->source)
+    {
+        lexer_skip(lex_process, scan_line_comment(lex_process->source + lex_process->offset, lexer_remaining(lex_process)));
+        return token_make_comment(lex_process, NULL);
+    }
 
-token_s *token_make_one_line_comment()
-{
-    buffer_s *buf = buffer_create();
+    buffer_s *buf = lexer_buffer_create(lex_process);
     char c = 0x00;
     LEX_GETC_IF(buf, c, (c != '\n' && c != EOF))
-    return token_create(&(token_s){.type=TOKEN_TYPE_COMMENT, .sval=buffer_ptr(buf)});
+    return token_make_comment(lex_process, buf);
 }
 
-token_s *token_make_multi_line_comment()
+token_s *token_make_multi_line_comment(lex_process_s *lex_process)
 {
-    buffer_s *buf = buffer_create();
+    if (lex_process->source)
+    {
+        size_t remaining = lexer_remaining(lex_process);
+        size_t len = scan_block_comment(lex_process->source + lex_process->offset, remaining);
+        if (len == remaining)
+        {
+            lexer_skip_lines(lex_process, len);
+            compile_error(lex_process->compiler, "You did not close this multi-line comment\n");
+        }
+
+        // Take the "*/" along
+        lexer_skip_lines(lex_process, len + 2);
+        return token_make_comment(lex_process, NULL);
+    }
+
+    buffer_s *buf = lexer_buffer_create(lex_process);
     char c = 0x00;
     while (1)
     {
@@ -500,42 +787,18 @@ token_s *token_make_multi_line_comment()
         }
         else if (c == '*')
         {
-            nextc();
-            if (peekc() == '/')
+            nextc(lex_process);
+            if (peekc(lex_process) == '/')
             {
-                nextc();
+                nextc(lex_process);
                 break;
             }
         }
     }
-    return token_create(&(token_s){.type=TOKEN_TYPE_COMMENT, .sval=buffer_ptr(buf)});
-}
-
-token_s *handle_comment()
-{
-    char c = peekc();
-    if (c == '/')
-    {
-        nextc();
-        if (peekc() == '/')
-        {
-            nextc();
-            return token_make_one_line_comment();
-        }
-        else if (peekc() == '*')
-        {
-            nextc();
-            return token_make_multi_line_comment();
-        }
-
-        pushc('/');
-        return token_make_operator_or_string();
-    }
-
-    return NULL;
+    return token_make_comment(lex_process, buf);
 }
 
-char lex_get_escaped_char(char c)
+char lex_get_escaped_char(lex_process_s *lex_process, char c)
 {
     char co = 0x00;
     switch (c)
@@ -559,140 +822,352 @@ char lex_get_escaped_char(char c)
     return co;
 }
 
-token_s *token_make_quote()
+token_s *token_make_quote(lex_process_s *lex_process)
 {
-    assert_next_char('\'');
-    char c = nextc();
+    assert_next_char(lex_process, '\'');
+    char c = nextc(lex_process);
     if (c == '\\')
     {
-        c = nextc();
-        c = lex_get_escaped_char(c);
+        c = nextc(lex_process);
+        c = lex_get_escaped_char(lex_process, c);
     }
 
-    if (nextc() != '\'')
+    if (nextc(lex_process) != '\'')
     {
         compile_error(lex_process->compiler, "You opened a quote ', but did not close it with a ' character");
     }
 
-    return token_create(&(token_s){.type=TOKEN_TYPE_NUMBER, .cval=c});
+    return token_create(lex_process, &(token_s){.type=TOKEN_TYPE_NUMBER, .cval=c});
+}
+
+static token_s *lexer_action_invalid(lex_process_s *lex_process)
+{
+    compile_error(lex_process->compiler, "Unexpecred token\n");
+    return NULL;
+}
+
+static token_s *lexer_action_end(lex_process_s *lex_process)
+{
+    // We have finished lexical analysis on the file
+    (void)lex_process;
+    return NULL;
 }
 
-token_s *read_next_token()
+static token_s *lexer_action_division(lex_process_s *lex_process)
 {
-    token_s *token = NULL;
-    char c = peekc();
+    // The '/' is already consumed, it can only be the start of an operator
+    return token_make_operator(lex_process, '/');
+}
+
+static token_s *lexer_action_dot(lex_process_s *lex_process)
+{
+    // The '.' is already consumed
+    return token_make_operator(lex_process, '.');
+}
+
+static token_s *lexer_action_string(lex_process_s *lex_process)
+{
+    return token_make_string(lex_process, '"', '"');
+}
+
+static token_s *lexer_action_line_comment(lex_process_s *lex_process)
+{
+    // The first '/' is already consumed
+    nextc(lex_process);
+    return token_make_one_line_comment(lex_process);
+}
+
+static token_s *lexer_action_block_comment(lex_process_s *lex_process)
+{
+    nextc(lex_process);
+    return token_make_multi_line_comment(lex_process);
+}
+
+static token_s *(*const lexer_actions[LEXER_ACTION_COUNT])(lex_process_s *lex_process) =
+{
+    [LEXER_ACTION_INVALID] = lexer_action_invalid,
+    [LEXER_ACTION_END] = lexer_action_end,
+    [LEXER_ACTION_NUMBER] = token_make_number,
+    [LEXER_ACTION_DOT] = lexer_action_dot,
+    [LEXER_ACTION_IDENTIFIER] = token_make_identifier_or_keyword,
+    [LEXER_ACTION_OPERATOR_OR_STRING] = token_make_operator_or_string,
+    [LEXER_ACTION_DIVISION] = lexer_action_division,
+    [LEXER_ACTION_SYMBOL] = token_make_symbol,
+    [LEXER_ACTION_STRING] = lexer_action_string,
+    [LEXER_ACTION_QUOTE] = token_make_quote,
+    [LEXER_ACTION_WHITESPACE] = handle_whitespace,
+    [LEXER_ACTION_NEWLINE] = token_make_newline,
+    [LEXER_ACTION_LINE_COMMENT] = lexer_action_line_comment,
+    [LEXER_ACTION_BLOCK_COMMENT] = lexer_action_block_comment
+};
+
+#ifdef LEXER_SWITCH_DISPATCH
+/**
+ * The switch over the case macros the tables replaced, it consumes the same
+ * characters and picks the same action. Only built into tools/lexer_check,
+ * which compares the token streams of both.
+ */
+static int lexer_switch_dispatch(lex_process_s *lex_process)
+{
+    char c = peekc(lex_process);
+    if (c == '/')
+    {
+        nextc(lex_process);
+        if (peekc(lex_process) == '/')
+        {
+            return LEXER_ACTION(LEXER_ACTION_LINE_COMMENT);
+        }
+        else if (peekc(lex_process) == '*')
+        {
+            return LEXER_ACTION(LEXER_ACTION_BLOCK_COMMENT);
+        }
+        return LEXER_ACTION(LEXER_ACTION_DIVISION);
+    }
 
-    token = handle_comment();
-    if (token != NULL)
+    if (c == '.')
     {
-        return token;
+        nextc(lex_process);
+        return isdigit((unsigned char)peekc(lex_process)) ? LEXER_ACTION(LEXER_ACTION_NUMBER) : LEXER_ACTION(LEXER_ACTION_DOT);
     }
 
     switch (c)
     {
     NUMERIC_CASE:
-        token = token_make_number();
-        break;
+        return LEXER_ACTION(LEXER_ACTION_NUMBER);
 
     OPERATOR_CASE_EXCLUDING_DIVISION:
-        token = token_make_operator_or_string();
-        break;
+        return LEXER_ACTION(LEXER_ACTION_OPERATOR_OR_STRING);
 
     SYMBOL_CASE:
-        token = token_make_symbol();
-        break;
-
-    case 'b':
-    case 'x':
-        token = token_make_special_number();
-        break;
+        return LEXER_ACTION(LEXER_ACTION_SYMBOL);
 
     case '"':
-        token = token_make_string('"', '"');
-        break;
+        return LEXER_ACTION(LEXER_ACTION_STRING);
 
     case '\'':
-        token = token_make_quote();
-        break;
+        return LEXER_ACTION(LEXER_ACTION_QUOTE);
 
     case ' ':
     case '\t':
-        // We don't care about whitespace, ignore them
-        token = handle_whitespace();
-        break;
+        return LEXER_ACTION(LEXER_ACTION_WHITESPACE);
 
     case '\n':
-        token = token_make_newline();
-        break;
+        return LEXER_ACTION(LEXER_ACTION_NEWLINE);
 
     case EOF:
-        // We have finished lexical analysis on the file
-        break;
+        return LEXER_ACTION(LEXER_ACTION_END);
+    }
 
-    default:
-        token = read_special_token();
-        if (NULL == token)
+    if (isalpha((unsigned char)c) || c == '_')
+    {
+        return LEXER_ACTION(LEXER_ACTION_IDENTIFIER);
+    }
+    return LEXER_ACTION(LEXER_ACTION_INVALID);
+}
+#else
+static int lexer_transition(lex_process_s *lex_process, lexer_state_e state)
+{
+    return lexer_transitions[state][lexer_char_class[(unsigned char)peekc(lex_process)]];
+}
+#endif
+
+token_s *read_next_token(lex_process_s *lex_process)
+{
+    lex_process->token_start = lex_process->offset;
+    lex_process->token_first = peekc(lex_process);
+#ifdef LEXER_SWITCH_DISPATCH
+    int next = lexer_switch_dispatch(lex_process);
+#else
+    // Moving to another state takes the character along, the action that
+    // ends the walk reads the rest of the token
+    int next = lexer_transition(lex_process, LEXER_STATE_START);
+    while (next < LEXER_STATE_COUNT)
+    {
+        nextc(lex_process);
+        next = lexer_transition(lex_process, next);
+    }
+#endif
+    return lexer_actions[next - LEXER_STATE_COUNT](lex_process);
+}
+
+void lex_start(lex_process_s *process, size_t offset)
+{
+    process->current_expression_count = 0;
+    process->pos.filename = process->compiler->cfile.abs_path;
+
+    process->offset = offset;
+    process->source = NULL;
+    process->source_size = 0;
+    if (process->function->source)
+    {
+        process->source = process->function->source(process, &process->source_size);
+    }
+
+    // Without a contiguous source the first peek fills the window
+    process->window = process->source;
+    process->window_offset = process->source ? 0 : offset;
+    process->window_size = process->source_size;
+    process->window_previous = EOF;
+
+    process->lookahead_head = 0;
+    process->lookahead_count = 0;
+    process->lookahead_end = false;
+}
+
+/**
+ * Lexes until the lookahead holds the wanted tokens and the one after them,
+ * the next token can still change the one before it.
+ * Returns false if the input ends first.
+ */
+static bool lexer_fill_lookahead(lex_process_s *lex_process, int wanted)
+{
+    while (lex_process->lookahead_count <= wanted && !lex_process->lookahead_end)
+    {
+        token_s *token = read_next_token(lex_process);
+        if (!token)
         {
-            compile_error(lex_process->compiler, "Unexpecred token\n");
+            lex_process->lookahead_end = true;
+            break;
         }
+
+        int tail = (lex_process->lookahead_head + lex_process->lookahead_count) % LEX_PROCESS_LOOKAHEAD;
+        lex_process->lookahead[tail] = *token;
+        lex_process->lookahead_count++;
+    }
+    return lex_process->lookahead_count >= wanted;
+}
+
+token_s *lex_next(lex_process_s *process)
+{
+    if (!lexer_fill_lookahead(process, 1))
+    {
+        return NULL;
     }
+
+    // The slot is only reused once the caller asks for more tokens
+    token_s *token = &process->lookahead[process->lookahead_head];
+    process->lookahead_head = (process->lookahead_head + 1) % LEX_PROCESS_LOOKAHEAD;
+    process->lookahead_count--;
     return token;
 }
 
-int lex(lex_process_s *process)
+token_s *lex_peek(lex_process_s *process, int k)
 {
-    process->current_expression_count = 0;
-    process->parentheses_buffer = NULL;
-    lex_process = process;
-    process->pos.filename = process->compiler->cfile.abs_path;
+    assert(k >= 0 && k < LEX_PROCESS_LOOKAHEAD - 1);
+    if (!lexer_fill_lookahead(process, k + 1))
+    {
+        return NULL;
+    }
+    return &process->lookahead[(process->lookahead_head + k) % LEX_PROCESS_LOOKAHEAD];
+}
 
-    token_s *token = read_next_token();
-    while (token != NULL)
+/**
+ * Gets the lexer past the token it failed on. The tokens already in the
+ * lookahead are kept, lexing goes on from the next character that can't
+ * belong to the bad token.
+ */
+static void lexer_resync(lex_process_s *lex_process)
+{
+    // Nothing was consumed, skip the character that could not start a token
+    if (lex_process->offset == lex_process->token_start && peekc(lex_process) != EOF)
     {
-        vector_push(process->token_vec, token);
-        token = read_next_token();
+        nextc(lex_process);
     }
 
-    return LEXICAL_ANALYSIS_ALL_OK;
+    // A character constant with too much in it ends at the next quote on the line
+    if (lex_process->token_first == '\'')
+    {
+        for (char c = peekc(lex_process); c != EOF && c != '\n'; c = peekc(lex_process))
+        {
+            nextc(lex_process);
+            if (c == '\'')
+            {
+                break;
+            }
+        }
+    }
+
+    // The rest of a bad number or a word glued to it would only fail again
+    for (char c = peekc(lex_process); isalnum((unsigned char)c) || c == '_'; c = peekc(lex_process))
+    {
+        nextc(lex_process);
+    }
+
+    if (lex_process->current_expression_count < 0)
+    {
+        lex_process->current_expression_count = 0;
+    }
 }
 
-char lexer_string_buffer_next_char(lex_process_s *process)
+int lex(lex_process_s *process)
 {
-    buffer_s *buf = lex_process_private(process);
-    return buffer_read(buf);
+    lex_start(process, 0);
+
+    // Knowing the input size up front, size the token vector once
+    // instead of growing it over and over while lexing
+    vector_reserve(process->token_vec, process->source_size / LEX_PROCESS_BYTES_PER_TOKEN);
+
+    // An error is reported, then we skip the bad token and go on so one
+    // run finds as many errors as it can
+    compile_process_s *compiler = process->compiler;
+    jmp_buf *failure_jmp = compiler->failure_jmp;
+    jmp_buf resync_jmp;
+    volatile int errors = 0;
+    compiler->failure_jmp = &resync_jmp;
+    if (setjmp(resync_jmp))
+    {
+        errors++;
+        lexer_resync(process);
+    }
+
+    for (token_s *token = lex_next(process); token; token = lex_next(process))
+    {
+        vector_push(process->token_vec, token);
+    }
+
+    compiler->failure_jmp = failure_jmp;
+    return errors ? LEXICAL_ANALYSIS_INPUT_ERROR : LEXICAL_ANALYSIS_ALL_OK;
 }
 
-char lexer_string_buffer_peek_char(lex_process_s *process)
+const char *lexer_string_buffer_fill(lex_process_s *process, size_t offset, size_t *size)
 {
     buffer_s *buf = lex_process_private(process);
-    return buffer_peek(buf);
+    size_t len = buf->len;
+    *size = offset < len ? len - offset : 0;
+    return (const char *)buffer_ptr(buf) + offset;
 }
 
-void lexer_string_buffer_push_char(lex_process_s *process, char c)
+const char *lexer_string_buffer_source(lex_process_s *process, size_t *size)
 {
     buffer_s *buf = lex_process_private(process);
-    buffer_write(buf, c);
+    *size = buf->len;
+    return buffer_ptr(buf);
 }
 
 lex_process_functions_s lexer_string_buffer_functions =
 {
-    .next_char = lexer_string_buffer_next_char,
-    .peek_char = lexer_string_buffer_peek_char,
-    .push_char = lexer_string_buffer_push_char
+    .fill = lexer_string_buffer_fill,
+    .source = lexer_string_buffer_source
 };
 
 lex_process_s *tokens_build_for_string(compile_process_s *compiler, const char *str)
 {
-    buffer_s *buf = buffer_create();
-    buffer_printf(buf, str);
+    buffer_s *buf = buffer_create_allocator(compiler->allocator);
+    buffer_write_bytes(buf, str, strlen(str));
     lex_process_s *lex_process = lex_process_create(compiler, &lexer_string_buffer_functions, buf);
     if (NULL == lex_process)
     {
         return NULL;
     }
 
-    if (lex(lex_process) != LEXICAL_ANALYSIS_ALL_OK)
+    // Lexing the string must not move the position of the file being compiled
+    pos_s pos = compiler->pos;
+    int res = lex(lex_process);
+    compiler->pos = pos;
+    if (res != LEXICAL_ANALYSIS_ALL_OK)
     {
+        lex_process_free(lex_process);
+        buffer_free(buf);
         return NULL;
     }
 
@@ -1,21 +1,255 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "helpers/vector.h"
+#include "helpers/buffer.h"
+#include "helpers/threadpool.h"
 #include "compiler.h"
 
-int main()
+// Bytes the token cache directory may hold unless --token-cache-size says otherwise
+#define DEFAULT_TOKEN_CACHE_SIZE (256 * 1024 * 1024)
+
+struct compile_job
+{
+    threadpool_s *pool;
+    token_cache_s *token_cache;
+    int flags;
+    bool print_stats;
+    compile_stats_s stats;
+    const char *filename;
+    char *filename_out;
+    int res;
+
+    // Collected while compiling and printed once every file is done,
+    // so the output is in input order no matter which thread finished first
+    diagnostics_s *diagnostics;
+};
+
+static void usage(const char *program)
+{
+    fprintf(stderr, "usage: %s [-j threads] [-o output] [--token-cache dir] [--token-cache-size MB] [--stdio-input] [--stats] file.c...\n", program);
+    fprintf(stderr, "       %s [-j threads] [--token-cache dir] [--token-cache-size MB] [--stdio-input] --server | --server-socket path\n", program);
+}
+
+// "dir/test.c" is written to "dir/test", "dir/test" to "dir/test.out"
+static char *default_output_filename(const char *filename)
 {
-    int res = compile_file("./test.c", "./test", 0);
-    if (res == COMPILER_FILE_COMPILED_OK)
+    size_t len = strlen(filename);
+    char *filename_out = malloc(len + sizeof(".out"));
+    memcpy(filename_out, filename, len + 1);
+    char *extension = strrchr(filename_out, '.');
+    char *directory = strrchr(filename_out, '/');
+    if (extension && (!directory || extension > directory + 1))
     {
-        printf("everything compiled fine.\n");
+        *extension = 0x00;
     }
-    else if (res == COMPILER_FAILED_WITH_ERRORS)
+    else
     {
-        printf("compile failed!\n");
+        // Without an extension to drop the output would be the source itself
+        strcat(filename_out, ".out");
+    }
+    return filename_out;
+}
+
+static void compile_job_run(void *arg)
+{
+    struct compile_job *job = arg;
+    // Big files are split up further on the same pool
+    compile_options_s options = {.flags = job->flags, .diagnostics = job->diagnostics, .pool = job->pool, .token_cache = job->token_cache};
+    if (job->print_stats)
+    {
+        options.stats = &job->stats;
+    }
+    job->res = compile_file_with_options(job->filename, job->filename_out, &options);
+}
+
+// Answers compile requests on stdin or a socket until asked to shut down
+static int serve(threadpool_s *pool, token_cache_s *token_cache, int flags, const char *socket_path)
+{
+    compile_options_s options = {.flags = flags, .pool = pool, .token_cache = token_cache};
+    compile_server_s *server = compile_server_create(&options);
+    int res = 0;
+    if (socket_path)
+    {
+        res = compile_server_listen(server, socket_path);
+        if (res != 0)
+        {
+            perror(socket_path);
+        }
     }
     else
     {
-        printf("unknown response for compile file!\n");
+        compile_server_serve(server, stdin, stdout);
+    }
+
+    compile_server_free(server);
+    return res ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *output = NULL;
+    const char *token_cache_directory = NULL;
+    size_t token_cache_size = DEFAULT_TOKEN_CACHE_SIZE;
+    int flags = 0;
+    bool print_stats = false;
+    bool server = false;
+    const char *server_socket = NULL;
+    int total_threads = 0;
+    int total_files = 0;
+    const char **files = calloc(argc, sizeof(const char *));
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (S_EQ(argv[i], "-o") && i + 1 < argc)
+        {
+            output = argv[++i];
+        }
+        else if (S_EQ(argv[i], "--token-cache") && i + 1 < argc)
+        {
+            token_cache_directory = argv[++i];
+        }
+        else if (S_EQ(argv[i], "--token-cache-size") && i + 1 < argc)
+        {
+            token_cache_size = strtoull(argv[++i], NULL, 10) * 1024 * 1024;
+        }
+        else if (S_EQ(argv[i], "--stdio-input"))
+        {
+            // Reads the sources through stdio instead of mapping them, to compare the two
+            flags |= COMPILE_PROCESS_FLAG_STDIO_INPUT;
+        }
+        else if (S_EQ(argv[i], "--stats"))
+        {
+            print_stats = true;
+        }
+        else if (S_EQ(argv[i], "--server"))
+        {
+            server = true;
+        }
+        else if (S_EQ(argv[i], "--server-socket") && i + 1 < argc)
+        {
+            server = true;
+            server_socket = argv[++i];
+        }
+        else if (S_EQ(argv[i], "-j") && i + 1 < argc)
+        {
+            total_threads = atoi(argv[++i]);
+        }
+        else if (strncmp(argv[i], "-j", 2) == 0 && argv[i][2])
+        {
+            total_threads = atoi(&argv[i][2]);
+        }
+        else if (argv[i][0] == '-')
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        else
+        {
+            files[total_files++] = argv[i];
+        }
+    }
+
+    if (total_files == 0 && !server)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (server && (total_files > 0 || output || print_stats))
+    {
+        fprintf(stderr, "the server takes its files from the requests, it has no -o or --stats\n");
+        return 1;
+    }
+
+    if (output && total_files > 1)
+    {
+        fprintf(stderr, "cannot use -o with multiple input files\n");
+        return 1;
     }
-    return 0;
+
+    token_cache_s *token_cache = NULL;
+    if (token_cache_directory)
+    {
+        token_cache = token_cache_create(token_cache_directory, token_cache_size);
+        if (!token_cache)
+        {
+            perror(token_cache_directory);
+            return 1;
+        }
+    }
+
+    // Zero starts one thread per CPU
+    struct threadpool *pool = threadpool_create(total_threads);
+    if (server)
+    {
+        int res = serve(pool, token_cache, flags, server_socket);
+        threadpool_free(pool);
+        if (token_cache)
+        {
+            // stdout carries the answers, keep it to the protocol
+            token_cache_print_stats(token_cache, stderr);
+            token_cache_free(token_cache);
+        }
+        free(files);
+        return res;
+    }
+    struct compile_job *jobs = calloc(total_files, sizeof(struct compile_job));
+    for (int i = 0; i < total_files; i++)
+    {
+        jobs[i].pool = pool;
+        jobs[i].token_cache = token_cache;
+        jobs[i].flags = flags;
+        jobs[i].print_stats = print_stats;
+        jobs[i].filename = files[i];
+        jobs[i].filename_out = output ? strdup(output) : default_output_filename(files[i]);
+        jobs[i].diagnostics = diagnostics_create(DIAGNOSTICS_DEFAULT_CAPACITY, DIAGNOSTICS_DEFAULT_TEXT_SIZE);
+    }
+
+    struct threadpool_group group = {0};
+    for (int i = 0; i < total_files; i++)
+    {
+        threadpool_submit(pool, &group, compile_job_run, &jobs[i]);
+    }
+    threadpool_wait(pool, &group);
+    threadpool_free(pool);
+
+    int failed = 0;
+    for (int i = 0; i < total_files; i++)
+    {
+        struct compile_job *job = &jobs[i];
+        diagnostics_print(job->diagnostics, stderr);
+        if (job->res == COMPILER_FILE_COMPILED_OK)
+        {
+            printf("%s: everything compiled fine.\n", job->filename);
+        }
+        else if (job->res == COMPILER_FAILED_WITH_ERRORS)
+        {
+            printf("%s: compile failed!\n", job->filename);
+            failed++;
+        }
+        else
+        {
+            printf("%s: unknown response for compile file!\n", job->filename);
+            failed++;
+        }
+
+        if (job->print_stats)
+        {
+            compile_stats_print_json(&job->stats, job->filename, stdout);
+        }
+
+        diagnostics_free(job->diagnostics);
+        free(job->filename_out);
+    }
+
+    if (token_cache)
+    {
+        token_cache_print_stats(token_cache, stdout);
+        token_cache_free(token_cache);
+    }
+
+    free(jobs);
+    free(files);
+    return failed ? 1 : 0;
 }
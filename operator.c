@@ -0,0 +1,214 @@
+#include "compiler.h"
+
+// The state of the operator DFA after reading "..", it only leads to "...",
+// without the third '.' it backs off to "."
+#define OPERATOR_STATE_DOT_DOT OPERATOR_COUNT
+#define OPERATOR_STATE_COUNT (OPERATOR_COUNT + 1)
+
+// Character classes of the characters that can appear in an operator,
+// zero is reserved for characters that never do.
+typedef enum _operator_char_class_e
+{
+    OPERATOR_CHAR_NONE,
+    OPERATOR_CHAR_PLUS,
+    OPERATOR_CHAR_MINUS,
+    OPERATOR_CHAR_STAR,
+    OPERATOR_CHAR_SLASH,
+    OPERATOR_CHAR_PERCENT,
+    OPERATOR_CHAR_NOT,
+    OPERATOR_CHAR_XOR,
+    OPERATOR_CHAR_BITWISE_NOT,
+    OPERATOR_CHAR_QUESTION,
+    OPERATOR_CHAR_EQUALS,
+    OPERATOR_CHAR_LESS,
+    OPERATOR_CHAR_GREATER,
+    OPERATOR_CHAR_PIPE,
+    OPERATOR_CHAR_AMPERSAND,
+    OPERATOR_CHAR_LEFT_PAREN,
+    OPERATOR_CHAR_LEFT_BRACKET,
+    OPERATOR_CHAR_COMMA,
+    OPERATOR_CHAR_DOT,
+    OPERATOR_CHAR_CLASS_COUNT
+} operator_char_class_e;
+
+static const unsigned char operator_char_classes[128] =
+{
+    ['+'] = OPERATOR_CHAR_PLUS,
+    ['-'] = OPERATOR_CHAR_MINUS,
+    ['*'] = OPERATOR_CHAR_STAR,
+    ['/'] = OPERATOR_CHAR_SLASH,
+    ['%'] = OPERATOR_CHAR_PERCENT,
+    ['!'] = OPERATOR_CHAR_NOT,
+    ['^'] = OPERATOR_CHAR_XOR,
+    ['~'] = OPERATOR_CHAR_BITWISE_NOT,
+    ['?'] = OPERATOR_CHAR_QUESTION,
+    ['='] = OPERATOR_CHAR_EQUALS,
+    ['<'] = OPERATOR_CHAR_LESS,
+    ['>'] = OPERATOR_CHAR_GREATER,
+    ['|'] = OPERATOR_CHAR_PIPE,
+    ['&'] = OPERATOR_CHAR_AMPERSAND,
+    ['('] = OPERATOR_CHAR_LEFT_PAREN,
+    ['['] = OPERATOR_CHAR_LEFT_BRACKET,
+    [','] = OPERATOR_CHAR_COMMA,
+    ['.'] = OPERATOR_CHAR_DOT
+};
+
+// Transitions of the operator DFA, a zero entry means there is no longer
+// operator to extend to. Every state except OPERATOR_STATE_DOT_DOT is
+// the operator it is named after, so the state we stop in is the result.
+static const unsigned char operator_transitions[OPERATOR_STATE_COUNT][OPERATOR_CHAR_CLASS_COUNT] =
+{
+    [OPERATOR_NONE] = {
+        [OPERATOR_CHAR_PLUS] = OPERATOR_PLUS,
+        [OPERATOR_CHAR_MINUS] = OPERATOR_MINUS,
+        [OPERATOR_CHAR_STAR] = OPERATOR_MULTIPLY,
+        [OPERATOR_CHAR_SLASH] = OPERATOR_DIVIDE,
+        [OPERATOR_CHAR_PERCENT] = OPERATOR_MODULO,
+        [OPERATOR_CHAR_NOT] = OPERATOR_LOGICAL_NOT,
+        [OPERATOR_CHAR_XOR] = OPERATOR_BITWISE_XOR,
+        [OPERATOR_CHAR_BITWISE_NOT] = OPERATOR_BITWISE_NOT,
+        [OPERATOR_CHAR_QUESTION] = OPERATOR_QUESTION,
+        [OPERATOR_CHAR_EQUALS] = OPERATOR_ASSIGN,
+        [OPERATOR_CHAR_LESS] = OPERATOR_LESS,
+        [OPERATOR_CHAR_GREATER] = OPERATOR_GREATER,
+        [OPERATOR_CHAR_PIPE] = OPERATOR_BITWISE_OR,
+        [OPERATOR_CHAR_AMPERSAND] = OPERATOR_BITWISE_AND,
+        [OPERATOR_CHAR_LEFT_PAREN] = OPERATOR_LEFT_PAREN,
+        [OPERATOR_CHAR_LEFT_BRACKET] = OPERATOR_LEFT_BRACKET,
+        [OPERATOR_CHAR_COMMA] = OPERATOR_COMMA,
+        [OPERATOR_CHAR_DOT] = OPERATOR_DOT
+    },
+    [OPERATOR_PLUS] = {
+        [OPERATOR_CHAR_PLUS] = OPERATOR_INCREMENT,
+        [OPERATOR_CHAR_EQUALS] = OPERATOR_PLUS_ASSIGN
+    },
+    [OPERATOR_MINUS] = {
+        [OPERATOR_CHAR_MINUS] = OPERATOR_DECREMENT,
+        [OPERATOR_CHAR_EQUALS] = OPERATOR_MINUS_ASSIGN,
+        [OPERATOR_CHAR_GREATER] = OPERATOR_ARROW
+    },
+    [OPERATOR_MULTIPLY] = {
+        [OPERATOR_CHAR_EQUALS] = OPERATOR_MULTIPLY_ASSIGN
+    },
+    [OPERATOR_DIVIDE] = {
+        [OPERATOR_CHAR_EQUALS] = OPERATOR_DIVIDE_ASSIGN
+    },
+    [OPERATOR_MODULO] = {
+        [OPERATOR_CHAR_EQUALS] = OPERATOR_MODULO_ASSIGN
+    },
+    [OPERATOR_LOGICAL_NOT] = {
+        [OPERATOR_CHAR_EQUALS] = OPERATOR_NOT_EQUAL
+    },
+    [OPERATOR_BITWISE_XOR] = {
+        [OPERATOR_CHAR_EQUALS] = OPERATOR_XOR_ASSIGN
+    },
+    [OPERATOR_ASSIGN] = {
+        [OPERATOR_CHAR_EQUALS] = OPERATOR_EQUAL
+    },
+    [OPERATOR_LESS] = {
+        [OPERATOR_CHAR_LESS] = OPERATOR_LEFT_SHIFT,
+        [OPERATOR_CHAR_EQUALS] = OPERATOR_LESS_EQUAL
+    },
+    [OPERATOR_GREATER] = {
+        [OPERATOR_CHAR_GREATER] = OPERATOR_RIGHT_SHIFT,
+        [OPERATOR_CHAR_EQUALS] = OPERATOR_GREATER_EQUAL
+    },
+    [OPERATOR_LEFT_SHIFT] = {
+        [OPERATOR_CHAR_EQUALS] = OPERATOR_LEFT_SHIFT_ASSIGN
+    },
+    [OPERATOR_RIGHT_SHIFT] = {
+        [OPERATOR_CHAR_EQUALS] = OPERATOR_RIGHT_SHIFT_ASSIGN
+    },
+    [OPERATOR_BITWISE_OR] = {
+        [OPERATOR_CHAR_PIPE] = OPERATOR_LOGICAL_OR,
+        [OPERATOR_CHAR_EQUALS] = OPERATOR_OR_ASSIGN
+    },
+    [OPERATOR_BITWISE_AND] = {
+        [OPERATOR_CHAR_AMPERSAND] = OPERATOR_LOGICAL_AND,
+        [OPERATOR_CHAR_EQUALS] = OPERATOR_AND_ASSIGN
+    },
+    [OPERATOR_DOT] = {
+        [OPERATOR_CHAR_DOT] = OPERATOR_STATE_DOT_DOT
+    },
+    [OPERATOR_STATE_DOT_DOT] = {
+        [OPERATOR_CHAR_DOT] = OPERATOR_ELLIPSIS
+    }
+};
+
+static const char *operator_names[OPERATOR_COUNT] =
+{
+    [OPERATOR_NONE] = NULL,
+    [OPERATOR_PLUS] = "+",
+    [OPERATOR_MINUS] = "-",
+    [OPERATOR_MULTIPLY] = "*",
+    [OPERATOR_DIVIDE] = "/",
+    [OPERATOR_MODULO] = "%",
+    [OPERATOR_LOGICAL_NOT] = "!",
+    [OPERATOR_BITWISE_XOR] = "^",
+    [OPERATOR_BITWISE_NOT] = "~",
+    [OPERATOR_QUESTION] = "?",
+    [OPERATOR_ASSIGN] = "=",
+    [OPERATOR_LESS] = "<",
+    [OPERATOR_GREATER] = ">",
+    [OPERATOR_BITWISE_OR] = "|",
+    [OPERATOR_BITWISE_AND] = "&",
+    [OPERATOR_LEFT_PAREN] = "(",
+    [OPERATOR_LEFT_BRACKET] = "[",
+    [OPERATOR_COMMA] = ",",
+    [OPERATOR_DOT] = ".",
+    [OPERATOR_PLUS_ASSIGN] = "+=",
+    [OPERATOR_MINUS_ASSIGN] = "-=",
+    [OPERATOR_MULTIPLY_ASSIGN] = "*=",
+    [OPERATOR_DIVIDE_ASSIGN] = "/=",
+    [OPERATOR_MODULO_ASSIGN] = "%=",
+    [OPERATOR_XOR_ASSIGN] = "^=",
+    [OPERATOR_OR_ASSIGN] = "|=",
+    [OPERATOR_AND_ASSIGN] = "&=",
+    [OPERATOR_LEFT_SHIFT_ASSIGN] = "<<=",
+    [OPERATOR_RIGHT_SHIFT_ASSIGN] = ">>=",
+    [OPERATOR_LEFT_SHIFT] = "<<",
+    [OPERATOR_RIGHT_SHIFT] = ">>",
+    [OPERATOR_LESS_EQUAL] = "<=",
+    [OPERATOR_GREATER_EQUAL] = ">=",
+    [OPERATOR_EQUAL] = "==",
+    [OPERATOR_NOT_EQUAL] = "!=",
+    [OPERATOR_LOGICAL_AND] = "&&",
+    [OPERATOR_LOGICAL_OR] = "||",
+    [OPERATOR_INCREMENT] = "++",
+    [OPERATOR_DECREMENT] = "--",
+    [OPERATOR_ARROW] = "->",
+    [OPERATOR_ELLIPSIS] = "..."
+};
+
+int operator_transition(int state, char c)
+{
+    unsigned char uc = c;
+    if (uc >= sizeof(operator_char_classes))
+    {
+        return OPERATOR_NONE;
+    }
+
+    return operator_transitions[state][operator_char_classes[uc]];
+}
+
+bool operator_state_is_accepting(int state)
+{
+    return state != OPERATOR_NONE && state != OPERATOR_STATE_DOT_DOT;
+}
+
+operator_e operator_state_fallback(int state, size_t *give_back)
+{
+    if (state == OPERATOR_STATE_DOT_DOT)
+    {
+        *give_back = 1;
+        return OPERATOR_DOT;
+    }
+
+    *give_back = 0;
+    return state;
+}
+
+const char *operator_name(operator_e op)
+{
+    return operator_names[op];
+}
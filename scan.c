@@ -0,0 +1,385 @@
+#include "compiler.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+typedef struct _scan_functions_s
+{
+    size_t (*identifier)(const char *data, size_t size);
+    size_t (*digits)(const char *data, size_t size);
+    size_t (*whitespace)(const char *data, size_t size);
+    size_t (*line_comment)(const char *data, size_t size);
+    size_t (*block_comment)(const char *data, size_t size);
+} scan_functions_s;
+
+static bool scan_is_identifier_char(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+static size_t scan_identifier_scalar(const char *data, size_t size)
+{
+    size_t i = 0;
+    while (i < size && scan_is_identifier_char(data[i]))
+    {
+        i++;
+    }
+    return i;
+}
+
+static size_t scan_digits_scalar(const char *data, size_t size)
+{
+    size_t i = 0;
+    while (i < size && data[i] >= '0' && data[i] <= '9')
+    {
+        i++;
+    }
+    return i;
+}
+
+static size_t scan_whitespace_scalar(const char *data, size_t size)
+{
+    size_t i = 0;
+    while (i < size && (data[i] == ' ' || data[i] == '\t'))
+    {
+        i++;
+    }
+    return i;
+}
+
+static size_t scan_line_comment_scalar(const char *data, size_t size)
+{
+    size_t i = 0;
+    while (i < size && data[i] != '\n')
+    {
+        i++;
+    }
+    return i;
+}
+
+static size_t scan_block_comment_scalar(const char *data, size_t size)
+{
+    for (size_t i = 0; i + 1 < size; i++)
+    {
+        if (data[i] == '*' && data[i + 1] == '/')
+        {
+            return i;
+        }
+    }
+    return size;
+}
+
+static const scan_functions_s scan_scalar =
+{
+    .identifier = scan_identifier_scalar,
+    .digits = scan_digits_scalar,
+    .whitespace = scan_whitespace_scalar,
+    .line_comment = scan_line_comment_scalar,
+    .block_comment = scan_block_comment_scalar
+};
+
+#ifdef SCAN_X86
+
+// The vector loops work on whole blocks and leave the last few bytes to
+// the scalar scanners, so nothing is ever read past the end of the data.
+// Every block is turned into a bit mask of the bytes that end the run.
+
+// Bytes of v in [low, high], unsigned compares through saturating subtraction
+#define SCAN_SSE2_RANGE(v, low, high) \
+    _mm_cmpeq_epi8(_mm_subs_epu8(_mm_sub_epi8(v, _mm_set1_epi8(low)), _mm_set1_epi8((high) - (low))), _mm_setzero_si128())
+
+#define SCAN_AVX2_RANGE(v, low, high) \
+    _mm256_cmpeq_epi8(_mm256_subs_epu8(_mm256_sub_epi8(v, _mm256_set1_epi8(low)), _mm256_set1_epi8((high) - (low))), _mm256_setzero_si256())
+
+__attribute__((target("sse2")))
+static size_t scan_identifier_sse2(const char *data, size_t size)
+{
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i letter = SCAN_SSE2_RANGE(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z');
+        __m128i digit = SCAN_SSE2_RANGE(v, '0', '9');
+        __m128i underscore = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+        unsigned int mask = ~_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(letter, digit), underscore)) & 0xffff;
+        if (mask)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + scan_identifier_scalar(data + i, size - i);
+}
+
+__attribute__((target("sse2")))
+static size_t scan_digits_sse2(const char *data, size_t size)
+{
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+        unsigned int mask = ~_mm_movemask_epi8(SCAN_SSE2_RANGE(v, '0', '9')) & 0xffff;
+        if (mask)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + scan_digits_scalar(data + i, size - i);
+}
+
+__attribute__((target("sse2")))
+static size_t scan_whitespace_sse2(const char *data, size_t size)
+{
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i space = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+        unsigned int mask = ~_mm_movemask_epi8(space) & 0xffff;
+        if (mask)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + scan_whitespace_scalar(data + i, size - i);
+}
+
+__attribute__((target("sse2")))
+static size_t scan_line_comment_sse2(const char *data, size_t size)
+{
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+        unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+        if (mask)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + scan_line_comment_scalar(data + i, size - i);
+}
+
+__attribute__((target("sse2")))
+static size_t scan_block_comment_sse2(const char *data, size_t size)
+{
+    // Compares every byte against '*' and the byte after it against '/'
+    size_t i = 0;
+    for (; i + 17 <= size; i += 16)
+    {
+        __m128i star = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + i)), _mm_set1_epi8('*'));
+        __m128i slash = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + i + 1)), _mm_set1_epi8('/'));
+        unsigned int mask = _mm_movemask_epi8(_mm_and_si128(star, slash));
+        if (mask)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + scan_block_comment_scalar(data + i, size - i);
+}
+
+static const scan_functions_s scan_sse2 =
+{
+    .identifier = scan_identifier_sse2,
+    .digits = scan_digits_sse2,
+    .whitespace = scan_whitespace_sse2,
+    .line_comment = scan_line_comment_sse2,
+    .block_comment = scan_block_comment_sse2
+};
+
+__attribute__((target("avx2")))
+static size_t scan_identifier_avx2(const char *data, size_t size)
+{
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+        __m256i letter = SCAN_AVX2_RANGE(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z');
+        __m256i digit = SCAN_AVX2_RANGE(v, '0', '9');
+        __m256i underscore = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+        unsigned int mask = ~(unsigned int)_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(letter, digit), underscore));
+        if (mask)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + scan_identifier_sse2(data + i, size - i);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_digits_avx2(const char *data, size_t size)
+{
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+        unsigned int mask = ~(unsigned int)_mm256_movemask_epi8(SCAN_AVX2_RANGE(v, '0', '9'));
+        if (mask)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + scan_digits_sse2(data + i, size - i);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_whitespace_avx2(const char *data, size_t size)
+{
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+        __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')));
+        unsigned int mask = ~(unsigned int)_mm256_movemask_epi8(space);
+        if (mask)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + scan_whitespace_sse2(data + i, size - i);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_line_comment_avx2(const char *data, size_t size)
+{
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+        unsigned int mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+        if (mask)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + scan_line_comment_sse2(data + i, size - i);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_block_comment_avx2(const char *data, size_t size)
+{
+    size_t i = 0;
+    for (; i + 33 <= size; i += 32)
+    {
+        __m256i star = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(data + i)), _mm256_set1_epi8('*'));
+        __m256i slash = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(data + i + 1)), _mm256_set1_epi8('/'));
+        unsigned int mask = _mm256_movemask_epi8(_mm256_and_si256(star, slash));
+        if (mask)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + scan_block_comment_sse2(data + i, size - i);
+}
+
+static const scan_functions_s scan_avx2 =
+{
+    .identifier = scan_identifier_avx2,
+    .digits = scan_digits_avx2,
+    .whitespace = scan_whitespace_avx2,
+    .line_comment = scan_line_comment_avx2,
+    .block_comment = scan_block_comment_avx2
+};
+
+#endif // SCAN_X86
+
+static const scan_functions_s *scan_functions = &scan_scalar;
+
+bool scan_isa_supported(scan_isa_e isa)
+{
+    switch (isa)
+    {
+    case SCAN_ISA_SCALAR:
+        return true;
+#ifdef SCAN_X86
+    case SCAN_ISA_SSE2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse2");
+    case SCAN_ISA_AVX2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+bool scan_select(scan_isa_e isa)
+{
+    if (!scan_isa_supported(isa))
+    {
+        return false;
+    }
+
+    switch (isa)
+    {
+#ifdef SCAN_X86
+    case SCAN_ISA_SSE2:
+        scan_functions = &scan_sse2;
+        break;
+    case SCAN_ISA_AVX2:
+        scan_functions = &scan_avx2;
+        break;
+#endif
+    default:
+        scan_functions = &scan_scalar;
+        break;
+    }
+    return true;
+}
+
+scan_isa_e scan_best_isa()
+{
+    if (scan_isa_supported(SCAN_ISA_AVX2))
+    {
+        return SCAN_ISA_AVX2;
+    }
+    if (scan_isa_supported(SCAN_ISA_SSE2))
+    {
+        return SCAN_ISA_SSE2;
+    }
+    return SCAN_ISA_SCALAR;
+}
+
+const char *scan_isa_name(scan_isa_e isa)
+{
+    static const char *names[] = {
+        [SCAN_ISA_SCALAR] = "scalar",
+        [SCAN_ISA_SSE2] = "sse2",
+        [SCAN_ISA_AVX2] = "avx2"
+    };
+    return names[isa];
+}
+
+// Picks the widest scanners the CPU has before any thread gets to lex
+__attribute__((constructor))
+static void scan_init()
+{
+    scan_select(scan_best_isa());
+}
+
+size_t scan_identifier(const char *data, size_t size)
+{
+    return scan_functions->identifier(data, size);
+}
+
+size_t scan_digits(const char *data, size_t size)
+{
+    return scan_functions->digits(data, size);
+}
+
+size_t scan_whitespace(const char *data, size_t size)
+{
+    return scan_functions->whitespace(data, size);
+}
+
+size_t scan_line_comment(const char *data, size_t size)
+{
+    return scan_functions->line_comment(data, size);
+}
+
+size_t scan_block_comment(const char *data, size_t size)
+{
+    return scan_functions->block_comment(data, size);
+}
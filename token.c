@@ -2,5 +2,25 @@
 
 bool token_is_keyword(token_s *token, const char *value)
 {
-    return token->type == TOKEN_TYPE_KEYWORD && S_EQ(token->sval, value);
+    return token_is_keyword_id(token, keyword_lookup(value, strlen(value)));
+}
+
+bool token_is_keyword_id(token_s *token, keyword_e keyword)
+{
+    return token && token->type == TOKEN_TYPE_KEYWORD && token->keyword == keyword;
+}
+
+const char *token_type_name(token_type_e type)
+{
+    static const char *names[TOKEN_TYPE_COUNT] = {
+        [TOKEN_TYPE_IDENTIFIER] = "identifier",
+        [TOKEN_TYPE_KEYWORD] = "keyword",
+        [TOKEN_TYPE_OPERATOR] = "operator",
+        [TOKEN_TYPE_SYMBOL] = "symbol",
+        [TOKEN_TYPE_NUMBER] = "number",
+        [TOKEN_TYPE_STRING] = "string",
+        [TOKEN_TYPE_COMMENT] = "comment",
+        [TOKEN_TYPE_NEWLINE] = "newline",
+    };
+    return type < TOKEN_TYPE_COUNT ? names[type] : "unknown";
 }
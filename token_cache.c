@@ -0,0 +1,584 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include "helpers/intern.h"
+#include "helpers/buffer.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+// Bump whenever the lexer or the layout below changes what a file turns into
+#define TOKEN_CACHE_VERSION 2
+#define TOKEN_CACHE_MAGIC "TOKCACHE"
+#define TOKEN_CACHE_EXTENSION ".tokens"
+
+/**
+ * A cache file is the header followed by the tokens, the brackets, the
+ * string table and the string bytes, all in host byte order. Everything is
+ * fixed size, so a load maps the file and reads the records where they are
+ * without parsing anything. The tokens are still copied into token_s and
+ * their strings interned, the rest of the compiler works on token_vec and
+ * intern ids of its own pool. The mapping is gone once the load returns.
+ */
+struct token_cache_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t token_size;
+    // The key, checked again in case two sources share a file name
+    uint64_t hash;
+    uint64_t source_size;
+    int32_t flags;
+
+    uint32_t total_tokens;
+    uint32_t total_brackets;
+    uint32_t total_strings;
+    uint64_t string_bytes;
+
+    // Where the lexer left off at the end of the source
+    uint32_t end_offset;
+    int32_t end_line;
+    int32_t end_col;
+    int32_t expression_count;
+};
+
+struct token_cache_token
+{
+    uint8_t type;
+    uint8_t flags;
+    uint8_t whitespace;
+    uint8_t number_type;
+    uint32_t offset;
+    uint32_t length;
+    int32_t line;
+    int32_t col;
+    uint32_t between_brackets;
+    // Index plus one into the string table, 0 if the token has no string
+    uint32_t string;
+    // keyword_e or operator_e
+    uint32_t id;
+    // The number, or the character of a symbol
+    uint64_t value;
+};
+
+struct token_cache_string
+{
+    uint32_t offset;
+    uint32_t length;
+};
+
+struct token_cache
+{
+    char *directory;
+    size_t max_size;
+
+    // Several files may be compiled at once, the statistics and the
+    // eviction scan are shared between them
+    pthread_mutex_t lock;
+    token_cache_stats_s stats;
+};
+
+struct token_cache_entry
+{
+    char *path;
+    off_t size;
+    time_t mtime;
+};
+
+token_cache_s *token_cache_create(const char *directory, size_t max_size)
+{
+    if (mkdir(directory, 0777) != 0 && errno != EEXIST)
+    {
+        return NULL;
+    }
+
+    token_cache_s *cache = calloc(1, sizeof(token_cache_s));
+    cache->directory = strdup(directory);
+    cache->max_size = max_size;
+    pthread_mutex_init(&cache->lock, NULL);
+    return cache;
+}
+
+void token_cache_free(token_cache_s *cache)
+{
+    pthread_mutex_destroy(&cache->lock);
+    free(cache->directory);
+    free(cache);
+}
+
+void token_cache_stats(token_cache_s *cache, token_cache_stats_s *stats)
+{
+    pthread_mutex_lock(&cache->lock);
+    *stats = cache->stats;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void token_cache_print_stats(token_cache_s *cache, FILE *fp)
+{
+    token_cache_stats_s stats;
+    token_cache_stats(cache, &stats);
+    fprintf(fp, "token cache: %zu hits, %zu misses, %zu stored, %zu evicted, %zu bytes loaded\n",
+            stats.hits, stats.misses, stats.stores, stats.evictions, stats.bytes_loaded);
+}
+
+static uint64_t token_cache_mix(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+uint64_t token_cache_hash(const char *data, size_t size, uint64_t seed)
+{
+    // Eight bytes at a time, the hash only has to tell sources apart
+    uint64_t h = seed ^ (size * 0x9e3779b97f4a7c15ull);
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        h = (h ^ token_cache_mix(word)) * 0x9e3779b97f4a7c15ull;
+    }
+
+    uint64_t tail = 0;
+    memcpy(&tail, data + i, size - i);
+    h = (h ^ token_cache_mix(tail)) * 0x9e3779b97f4a7c15ull;
+    return token_cache_mix(h);
+}
+
+static char *token_cache_path(token_cache_s *cache, uint64_t hash)
+{
+    size_t len = strlen(cache->directory) + 1 + 16 + sizeof(TOKEN_CACHE_EXTENSION);
+    char *path = malloc(len);
+    snprintf(path, len, "%s/%016llx" TOKEN_CACHE_EXTENSION, cache->directory, (unsigned long long)hash);
+    return path;
+}
+
+static void token_cache_count(token_cache_s *cache, size_t *counter, size_t amount)
+{
+    pthread_mutex_lock(&cache->lock);
+    *counter += amount;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+static size_t token_cache_file_size(struct token_cache_header *header)
+{
+    return sizeof(struct token_cache_header) + header->total_tokens * sizeof(struct token_cache_token) +
+           header->total_brackets * sizeof(lex_brackets_s) + header->total_strings * sizeof(struct token_cache_string) +
+           header->string_bytes;
+}
+
+/**
+ * Every index and offset in the records points inside the file or the source,
+ * a file that was corrupted but kept its header and size is a miss
+ */
+static bool token_cache_valid_records(struct token_cache_header *header)
+{
+    struct token_cache_token *records = (struct token_cache_token *)(header + 1);
+    lex_brackets_s *brackets = (lex_brackets_s *)(records + header->total_tokens);
+    struct token_cache_string *strings = (struct token_cache_string *)(brackets + header->total_brackets);
+
+    for (uint32_t i = 0; i < header->total_strings; i++)
+    {
+        if ((uint64_t)strings[i].offset + strings[i].length > header->string_bytes)
+        {
+            return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < header->total_brackets; i++)
+    {
+        if (brackets[i].start > header->source_size || brackets[i].end > header->source_size)
+        {
+            return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < header->total_tokens; i++)
+    {
+        struct token_cache_token *record = &records[i];
+        if (record->string > header->total_strings || record->between_brackets > header->total_brackets ||
+            (uint64_t)record->offset + record->length > header->source_size)
+        {
+            return false;
+        }
+
+        if ((record->type == TOKEN_TYPE_KEYWORD && record->id >= KEYWORD_COUNT) ||
+            (record->type == TOKEN_TYPE_OPERATOR && record->id >= OPERATOR_COUNT))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool token_cache_valid(struct token_cache_header *header, size_t file_size, uint64_t hash, size_t source_size, int flags)
+{
+    // The string bytes are checked on their own, a huge count could wrap the total size around
+    return file_size >= sizeof(struct token_cache_header) &&
+           memcmp(header->magic, TOKEN_CACHE_MAGIC, sizeof(header->magic)) == 0 &&
+           header->version == TOKEN_CACHE_VERSION &&
+           header->token_size == sizeof(struct token_cache_token) &&
+           header->hash == hash && header->source_size == source_size && header->flags == flags &&
+           header->string_bytes <= file_size && token_cache_file_size(header) == file_size &&
+           header->end_offset <= source_size &&
+           token_cache_valid_records(header);
+}
+
+/**
+ * Fills the process from a mapped cache file as if it had lexed the source,
+ * one copy per token and one intern per distinct string
+ */
+static void token_cache_read(lex_process_s *process, struct token_cache_header *header)
+{
+    struct token_cache_token *records = (struct token_cache_token *)(header + 1);
+    lex_brackets_s *brackets = (lex_brackets_s *)(records + header->total_tokens);
+    struct token_cache_string *strings = (struct token_cache_string *)(brackets + header->total_brackets);
+    const char *string_bytes = (const char *)(strings + header->total_strings);
+
+    // Every distinct string is interned once, the tokens only look them up
+    intern_pool_s *interns = process->compiler->interns;
+    uint32_t *sids = malloc(sizeof(uint32_t) * (header->total_strings + 1));
+    for (uint32_t i = 0; i < header->total_strings; i++)
+    {
+        sids[i + 1] = intern_pool_intern(interns, string_bytes + strings[i].offset, strings[i].length);
+    }
+
+    vector_clear(process->token_vec);
+    vector_stretch(process->token_vec, header->total_tokens);
+    token_s *tokens = vector_data_ptr(process->token_vec);
+    for (uint32_t i = 0; i < header->total_tokens; i++)
+    {
+        struct token_cache_token *record = &records[i];
+        token_s *token = &tokens[i];
+        memset(token, 0, sizeof(token_s));
+        token->type = record->type;
+        token->flags = record->flags;
+        token->whitespace = record->whitespace;
+        token->num.type = record->number_type;
+        token->slice.offset = record->offset;
+        token->slice.length = record->length;
+        token->pos.line = record->line;
+        token->pos.col = record->col;
+        token->pos.filename = process->compiler->cfile.abs_path;
+        token->between_brackets = record->between_brackets;
+        token->llnum = record->value;
+        if (record->string)
+        {
+            token->sval = intern_pool_str(interns, sids[record->string]);
+            // Only comments are interned just for the cache
+            if (token->type != TOKEN_TYPE_COMMENT)
+            {
+                token->sid = sids[record->string];
+            }
+        }
+
+        if (token->type == TOKEN_TYPE_KEYWORD)
+        {
+            token->keyword = record->id;
+        }
+        else if (token->type == TOKEN_TYPE_OPERATOR)
+        {
+            token->op = record->id;
+            token->sval = operator_name(token->op);
+        }
+    }
+    free(sids);
+
+    vector_clear(process->brackets);
+    vector_stretch(process->brackets, header->total_brackets);
+    memcpy(vector_data_ptr(process->brackets), brackets, header->total_brackets * sizeof(lex_brackets_s));
+
+    process->offset = header->end_offset;
+    process->pos.line = header->end_line;
+    process->pos.col = header->end_col;
+    process->current_expression_count = header->expression_count;
+}
+
+bool token_cache_load(token_cache_s *cache, lex_process_s *process, int flags)
+{
+    size_t source_size = 0;
+    const char *source = compile_process_source(process->compiler, &source_size);
+    if (!source)
+    {
+        return false;
+    }
+
+    uint64_t hash = token_cache_hash(source, source_size, flags);
+    char *path = token_cache_path(cache, hash);
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(struct token_cache_header))
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        free(path);
+        token_cache_count(cache, &cache->stats.misses, 1);
+        return false;
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    bool hit = data != MAP_FAILED && token_cache_valid(data, st.st_size, hash, source_size, flags);
+    if (hit)
+    {
+        token_cache_read(process, data);
+        // Mark the file as recently used for the eviction
+        utime(path, NULL);
+    }
+
+    if (data != MAP_FAILED)
+    {
+        munmap(data, st.st_size);
+    }
+    free(path);
+
+    pthread_mutex_lock(&cache->lock);
+    if (hit)
+    {
+        cache->stats.hits++;
+        cache->stats.bytes_loaded += st.st_size;
+    }
+    else
+    {
+        cache->stats.misses++;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return hit;
+}
+
+/**
+ * Index plus one of the string of the token in the string table, the string
+ * is added the first time its intern id is seen
+ */
+static uint32_t token_cache_string_for(token_s *token, intern_pool_s *interns, uint32_t *indexes, vector_s *strings, buffer_s *string_bytes)
+{
+    if ((token->type != TOKEN_TYPE_IDENTIFIER && token->type != TOKEN_TYPE_KEYWORD &&
+         token->type != TOKEN_TYPE_STRING && token->type != TOKEN_TYPE_COMMENT) || !token->sval)
+    {
+        return 0;
+    }
+
+    // Comments that weren't sliced from the source aren't interned
+    uint32_t sid = token->sid;
+    if (token->type == TOKEN_TYPE_COMMENT)
+    {
+        sid = intern_pool_intern(interns, token->sval, strlen(token->sval));
+    }
+
+    if (!indexes[sid])
+    {
+        struct token_cache_string string = {.offset = string_bytes->len, .length = intern_pool_len(interns, sid)};
+        buffer_write_bytes(string_bytes, intern_pool_str(interns, sid), string.length);
+        vector_push(strings, &string);
+        indexes[sid] = vector_count(strings);
+    }
+    return indexes[sid];
+}
+
+static int token_cache_entry_compare(const void *a, const void *b)
+{
+    const struct token_cache_entry *x = a;
+    const struct token_cache_entry *y = b;
+    return (x->mtime > y->mtime) - (x->mtime < y->mtime);
+}
+
+/**
+ * Removes the least recently used files until the directory fits in max_size
+ */
+static void token_cache_evict(token_cache_s *cache)
+{
+    DIR *dir = opendir(cache->directory);
+    if (!dir)
+    {
+        return;
+    }
+
+    vector_s *entries = vector_create(sizeof(struct token_cache_entry));
+    size_t total_size = 0;
+    size_t extension_length = strlen(TOKEN_CACHE_EXTENSION);
+    for (struct dirent *dirent = readdir(dir); dirent; dirent = readdir(dir))
+    {
+        size_t len = strlen(dirent->d_name);
+        if (len <= extension_length || strcmp(dirent->d_name + len - extension_length, TOKEN_CACHE_EXTENSION) != 0)
+        {
+            continue;
+        }
+
+        size_t path_len = strlen(cache->directory) + 1 + len + 1;
+        struct token_cache_entry entry = {.path = malloc(path_len)};
+        snprintf(entry.path, path_len, "%s/%s", cache->directory, dirent->d_name);
+        struct stat st;
+        if (stat(entry.path, &st) != 0)
+        {
+            free(entry.path);
+            continue;
+        }
+        entry.size = st.st_size;
+        entry.mtime = st.st_mtime;
+        total_size += st.st_size;
+        vector_push(entries, &entry);
+    }
+    closedir(dir);
+
+    qsort(vector_data_ptr(entries), vector_count(entries), sizeof(struct token_cache_entry), token_cache_entry_compare);
+    for (int i = 0; i < vector_count(entries); i++)
+    {
+        struct token_cache_entry *entry = vector_at(entries, i);
+        if (total_size > cache->max_size && unlink(entry->path) == 0)
+        {
+            total_size -= entry->size;
+            cache->stats.evictions++;
+        }
+        free(entry->path);
+    }
+    vector_free(entries);
+}
+
+void token_cache_store(token_cache_s *cache, lex_process_s *process, int flags)
+{
+    // The cache keeps no warnings, a file with any is lexed every time so
+    // they are reported every time
+    if (process->compiler->warnings)
+    {
+        return;
+    }
+
+    size_t source_size = 0;
+    const char *source = compile_process_source(process->compiler, &source_size);
+    if (!source)
+    {
+        return;
+    }
+
+    intern_pool_s *interns = process->compiler->interns;
+    vector_s *tokens = process->token_vec;
+    struct token_cache_header header = {
+        .version = TOKEN_CACHE_VERSION,
+        .token_size = sizeof(struct token_cache_token),
+        .hash = token_cache_hash(source, source_size, flags),
+        .source_size = source_size,
+        .flags = flags,
+        .total_tokens = vector_count(tokens),
+        .total_brackets = vector_count(process->brackets),
+        .end_offset = source_size,
+        .end_line = process->pos.line,
+        .end_col = process->pos.col,
+        .expression_count = process->current_expression_count,
+    };
+    memcpy(header.magic, TOKEN_CACHE_MAGIC, sizeof(header.magic));
+
+    struct token_cache_token *records = calloc(header.total_tokens, sizeof(struct token_cache_token));
+    vector_s *strings = vector_create(sizeof(struct token_cache_string));
+    buffer_s *string_bytes = buffer_create();
+    size_t total_indexes = 0;
+    uint32_t *indexes = NULL;
+    for (uint32_t i = 0; i < header.total_tokens; i++)
+    {
+        token_s *token = vector_at(tokens, i);
+        struct token_cache_token *record = &records[i];
+        record->type = token->type;
+        record->flags = token->flags;
+        record->whitespace = token->whitespace;
+        record->number_type = token->num.type;
+        record->offset = token->slice.offset;
+        record->length = token->slice.length;
+        record->line = token->pos.line;
+        record->col = token->pos.col;
+        record->between_brackets = token->between_brackets;
+
+        switch (token->type)
+        {
+        case TOKEN_TYPE_NUMBER:
+        case TOKEN_TYPE_SYMBOL:
+            record->value = token->llnum;
+            break;
+        case TOKEN_TYPE_KEYWORD:
+            record->id = token->keyword;
+            break;
+        case TOKEN_TYPE_OPERATOR:
+            record->id = token->op;
+            break;
+        }
+
+        // Comments may add strings to the pool, size the table for them
+        if (total_indexes <= intern_pool_count(interns))
+        {
+            size_t total = intern_pool_count(interns) * 2 + 1;
+            indexes = realloc(indexes, sizeof(uint32_t) * total);
+            memset(indexes + total_indexes, 0, sizeof(uint32_t) * (total - total_indexes));
+            total_indexes = total;
+        }
+        record->string = token_cache_string_for(token, interns, indexes, strings, string_bytes);
+    }
+    header.total_strings = vector_count(strings);
+    header.string_bytes = string_bytes->len;
+
+    // A file that doesn't fit would only push everything else out
+    if (cache->max_size && token_cache_file_size(&header) > cache->max_size)
+    {
+        free(indexes);
+        buffer_free(string_bytes);
+        vector_free(strings);
+        free(records);
+        return;
+    }
+
+    // Written aside and renamed so readers never see half a file
+    char *path = token_cache_path(cache, header.hash);
+    size_t temp_len = strlen(cache->directory) + sizeof("/.tmpXXXXXX");
+    char *temp_path = malloc(temp_len);
+    snprintf(temp_path, temp_len, "%s/.tmpXXXXXX", cache->directory);
+    int fd = mkstemp(temp_path);
+    if (fd >= 0)
+    {
+        fchmod(fd, 0644);
+    }
+    FILE *fp = fd >= 0 ? fdopen(fd, "wb") : NULL;
+    if (fp)
+    {
+        fwrite(&header, sizeof(header), 1, fp);
+        fwrite(records, sizeof(struct token_cache_token), header.total_tokens, fp);
+        fwrite(vector_data_ptr(process->brackets), sizeof(lex_brackets_s), header.total_brackets, fp);
+        fwrite(vector_data_ptr(strings), sizeof(struct token_cache_string), header.total_strings, fp);
+        fwrite(buffer_ptr(string_bytes), 1, string_bytes->len, fp);
+        bool written = !ferror(fp);
+        if (fclose(fp) == 0 && written && rename(temp_path, path) == 0)
+        {
+            pthread_mutex_lock(&cache->lock);
+            cache->stats.stores++;
+            if (cache->max_size)
+            {
+                token_cache_evict(cache);
+            }
+            pthread_mutex_unlock(&cache->lock);
+        }
+        else
+        {
+            unlink(temp_path);
+        }
+    }
+    else if (fd >= 0)
+    {
+        close(fd);
+        unlink(temp_path);
+    }
+
+    free(temp_path);
+    free(path);
+    free(indexes);
+    buffer_free(string_bytes);
+    vector_free(strings);
+    free(records);
+}
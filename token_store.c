@@ -0,0 +1,306 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include "helpers/intern.h"
+#include <stdlib.h>
+#include <assert.h>
+
+#define TOKEN_STORE_INITIAL_CAPACITY 1024
+
+token_store_s *token_store_create(intern_pool_s *interns)
+{
+    token_store_s *store = calloc(1, sizeof(token_store_s));
+    store->files = vector_create(sizeof(token_store_file_s));
+    store->wide_numbers = vector_create(sizeof(token_store_number_s));
+    store->interns = interns;
+    return store;
+}
+
+void token_store_free(token_store_s *store)
+{
+    for (int i = 0; i < vector_count(store->files); i++)
+    {
+        token_store_file_s *file = vector_at(store->files, i);
+        vector_free(file->lines);
+    }
+
+    vector_free(store->files);
+    vector_free(store->wide_numbers);
+    free(store->types);
+    free(store->offsets);
+    free(store->payloads);
+    free(store->file_ids);
+    free(store);
+}
+
+static void token_store_reserve(token_store_s *store, size_t total)
+{
+    if (total <= store->capacity)
+    {
+        return;
+    }
+
+    size_t capacity = store->capacity ? store->capacity : TOKEN_STORE_INITIAL_CAPACITY;
+    while (capacity < total)
+    {
+        capacity *= 2;
+    }
+
+    store->types = realloc(store->types, capacity * sizeof(*store->types));
+    store->offsets = realloc(store->offsets, capacity * sizeof(*store->offsets));
+    store->payloads = realloc(store->payloads, capacity * sizeof(*store->payloads));
+    store->file_ids = realloc(store->file_ids, capacity * sizeof(*store->file_ids));
+    assert(store->types && store->offsets && store->payloads && store->file_ids);
+    store->capacity = capacity;
+}
+
+static unsigned int token_store_number_payload(token_store_s *store, token_s *token, unsigned char *type)
+{
+    int flags = token->flags & TOKEN_FLAG_NUMBER_MASK;
+    if (token->llnum <= 0xffffffffull && !flags)
+    {
+        return token->llnum;
+    }
+
+    token_store_number_s number = {.value = token->llnum, .flags = flags};
+    *type |= TOKEN_STORE_WIDE_NUMBER;
+    vector_push(store->wide_numbers, &number);
+    return vector_count(store->wide_numbers) - 1;
+}
+
+static unsigned int token_store_comment_payload(token_store_s *store, token_s *token, unsigned char *type)
+{
+    if (token->flags & TOKEN_FLAG_SOURCE_SLICE)
+    {
+        *type |= TOKEN_STORE_SOURCE_SLICE;
+        return token->slice.length;
+    }
+
+    // Comments that weren't sliced own their text, keep it in the intern pool
+    return intern_pool_intern(store->interns, token->sval, strlen(token->sval));
+}
+
+static unsigned int token_store_payload_for(token_store_s *store, token_s *token, unsigned char *type)
+{
+    switch (token->type)
+    {
+    case TOKEN_TYPE_IDENTIFIER:
+    case TOKEN_TYPE_STRING:
+        return token->sid;
+
+    case TOKEN_TYPE_KEYWORD:
+        return token->keyword;
+
+    case TOKEN_TYPE_OPERATOR:
+        return token->op;
+
+    case TOKEN_TYPE_SYMBOL:
+        return (unsigned char)token->cval;
+
+    case TOKEN_TYPE_NUMBER:
+        *type |= token->num.type << TOKEN_STORE_NUMBER_TYPE_SHIFT;
+        return token_store_number_payload(store, token, type);
+
+    case TOKEN_TYPE_COMMENT:
+        return token_store_comment_payload(store, token, type);
+    }
+
+    return 0;
+}
+
+static void token_store_record_line(token_store_file_s *file, token_s *token)
+{
+    // pos is where the token ends, walk it back to the start of its line
+    unsigned int end = token->slice.offset + token->slice.length;
+    token_store_line_s line = {.offset = end - (token->pos.col - 1), .line = token->pos.line};
+    token_store_line_s *last = vector_back_or_null(file->lines);
+    if (last && last->line == line.line)
+    {
+        return;
+    }
+
+    vector_push(file->lines, &line);
+}
+
+int token_store_append(token_store_s *store, lex_process_s *lex_process)
+{
+    assert(store->interns == lex_process->compiler->interns);
+
+    int file_id = vector_count(store->files);
+    token_store_file_s file = {
+        .filename = lex_process->pos.filename,
+        .source = lex_process->source,
+        .lines = vector_create(sizeof(token_store_line_s))
+    };
+
+    token_store_line_s first_line = {.offset = 0, .line = 1};
+    vector_push(file.lines, &first_line);
+
+    vector_s *tokens = lex_process->token_vec;
+    size_t total = vector_count(tokens);
+    token_store_reserve(store, store->count + total);
+    for (size_t i = 0; i < total; i++)
+    {
+        token_s *token = vector_at(tokens, i);
+        size_t index = store->count++;
+
+        unsigned char type = token->type;
+        if (token->whitespace)
+        {
+            type |= TOKEN_STORE_WHITESPACE;
+        }
+
+        store->payloads[index] = token_store_payload_for(store, token, &type);
+        store->types[index] = type;
+        store->offsets[index] = token->slice.offset;
+        store->file_ids[index] = file_id;
+        token_store_record_line(&file, token);
+    }
+
+    vector_push(store->files, &file);
+    return file_id;
+}
+
+const char *token_store_text(token_store_s *store, size_t index, size_t *len)
+{
+    unsigned int payload = store->payloads[index];
+    switch (token_store_type(store, index))
+    {
+    case TOKEN_TYPE_IDENTIFIER:
+    case TOKEN_TYPE_STRING:
+        *len = intern_pool_len(store->interns, payload);
+        return intern_pool_str(store->interns, payload);
+
+    case TOKEN_TYPE_KEYWORD:
+        *len = strlen(keyword_name(payload));
+        return keyword_name(payload);
+
+    case TOKEN_TYPE_OPERATOR:
+        *len = strlen(operator_name(payload));
+        return operator_name(payload);
+
+    case TOKEN_TYPE_COMMENT:
+        if (store->types[index] & TOKEN_STORE_SOURCE_SLICE)
+        {
+            token_store_file_s *file = vector_at(store->files, store->file_ids[index]);
+            const char *text = file->source + store->offsets[index];
+            // Strip the "//" or the "/*" and "*/" delimiters
+            bool multi_line = text[1] == '*';
+            *len = payload - (multi_line ? 4 : 2);
+            return text + 2;
+        }
+        *len = intern_pool_len(store->interns, payload);
+        return intern_pool_str(store->interns, payload);
+
+    default:
+        // Numbers, symbols and newlines keep no text of their own
+        break;
+    }
+
+    *len = 0;
+    return NULL;
+}
+
+unsigned long long token_store_number(token_store_s *store, size_t index)
+{
+    if (store->types[index] & TOKEN_STORE_WIDE_NUMBER)
+    {
+        return ((token_store_number_s *)vector_at(store->wide_numbers, store->payloads[index]))->value;
+    }
+
+    return store->payloads[index];
+}
+
+pos_s token_store_pos(token_store_s *store, size_t index)
+{
+    token_store_file_s *file = vector_at(store->files, store->file_ids[index]);
+    unsigned int offset = store->offsets[index];
+
+    // Find the last line that starts at or before the token
+    int low = 0;
+    int high = vector_count(file->lines) - 1;
+    while (low < high)
+    {
+        int mid = (low + high + 1) / 2;
+        token_store_line_s *line = vector_at(file->lines, mid);
+        if (line->offset <= offset)
+        {
+            low = mid;
+        }
+        else
+        {
+            high = mid - 1;
+        }
+    }
+
+    token_store_line_s *line = vector_at(file->lines, low);
+    return (pos_s){.line = line->line, .col = offset - line->offset + 1, .filename = file->filename};
+}
+
+void token_store_get(token_store_s *store, size_t index, token_s *token)
+{
+    memset(token, 0, sizeof(token_s));
+    unsigned char type = store->types[index];
+    unsigned int payload = store->payloads[index];
+    token->type = type & TOKEN_STORE_TYPE_MASK;
+    token->whitespace = type & TOKEN_STORE_WHITESPACE;
+    token->pos = token_store_pos(store, index);
+    token->slice.offset = store->offsets[index];
+
+    size_t len = 0;
+    switch (token->type)
+    {
+    case TOKEN_TYPE_IDENTIFIER:
+    case TOKEN_TYPE_STRING:
+        token->sid = payload;
+        token->sval = token_store_text(store, index, &len);
+        break;
+
+    case TOKEN_TYPE_KEYWORD:
+        token->keyword = payload;
+        token->sval = keyword_name(payload);
+        break;
+
+    case TOKEN_TYPE_OPERATOR:
+        token->op = payload;
+        token->sval = operator_name(payload);
+        break;
+
+    case TOKEN_TYPE_SYMBOL:
+        token->cval = payload;
+        break;
+
+    case TOKEN_TYPE_NUMBER:
+        token->llnum = token_store_number(store, index);
+        if (type & TOKEN_STORE_WIDE_NUMBER)
+        {
+            token->flags |= ((token_store_number_s *)vector_at(store->wide_numbers, payload))->flags;
+        }
+        token->num.type = (type & TOKEN_STORE_NUMBER_TYPE_MASK) >> TOKEN_STORE_NUMBER_TYPE_SHIFT;
+        break;
+
+    case TOKEN_TYPE_COMMENT:
+        if (type & TOKEN_STORE_SOURCE_SLICE)
+        {
+            token->flags |= TOKEN_FLAG_SOURCE_SLICE;
+            token->slice.length = payload;
+        }
+        else
+        {
+            token->sval = token_store_text(store, index, &len);
+        }
+        break;
+    }
+}
+
+size_t token_store_memory_usage(token_store_s *store)
+{
+    size_t per_token = sizeof(*store->types) + sizeof(*store->offsets) + sizeof(*store->payloads) + sizeof(*store->file_ids);
+    size_t total = store->capacity * per_token;
+    total += vector_count(store->wide_numbers) * sizeof(token_store_number_s);
+    for (int i = 0; i < vector_count(store->files); i++)
+    {
+        token_store_file_s *file = vector_at(store->files, i);
+        total += sizeof(token_store_file_s) + vector_count(file->lines) * sizeof(token_store_line_s);
+    }
+    return total;
+}
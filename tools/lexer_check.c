@@ -0,0 +1,163 @@
+#include "compiler.h"
+#include "helpers/buffer.h"
+#include "helpers/vector.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// Lexes every file it is given and a number of random inputs, then prints
+// the tokens, parentheses and diagnostics of each. Built once with the
+// generated dispatch tables and once with -DLEXER_SWITCH_DISPATCH, the
+// check target fails when the two print anything different.
+// Usage: lexer_check [--random count] file...
+
+// Pieces the random inputs are glued from, with a random byte now and then
+static const char *lexer_check_pieces[] =
+{
+    "int", "x1", "_y", "return", " ", "\t", "\n", "(", ")", "[", "]", "{", "}",
+    "/", "//", "/*", "*/", "*", ".", "..", "...", "->", "<<=", ">>", "+", "-",
+    "=", "==", "!", "&&", "|", "?", ":", ";", ",", "#", "\\", "\"", "'", "\"a\\\"b\"",
+    "'c'", "'\\n'", "0", "7", "42", "0x1F", "0b101", "0x", "08", "1.5", "1e3",
+    "1e", ".5f", "3ull", "12abc", "0x.p1", "1e999f", "@", "$", "`",
+};
+
+#define LEXER_CHECK_MAX_PIECES 64
+
+extern lex_process_functions_s lexer_string_buffer_functions;
+
+static unsigned int lexer_check_seed = 1;
+
+static unsigned int lexer_check_random()
+{
+    lexer_check_seed = lexer_check_seed * 1103515245 + 12345;
+    return lexer_check_seed >> 16;
+}
+
+static void lexer_check_random_input(buffer_s *buf)
+{
+    int total_pieces = lexer_check_random() % LEXER_CHECK_MAX_PIECES;
+    for (int i = 0; i < total_pieces; i++)
+    {
+        if (lexer_check_random() % 8 == 0)
+        {
+            buffer_write(buf, (char)(lexer_check_random() & 0xff));
+            continue;
+        }
+
+        const char *piece = lexer_check_pieces[lexer_check_random() % (sizeof(lexer_check_pieces) / sizeof(lexer_check_pieces[0]))];
+        buffer_write_bytes(buf, piece, strlen(piece));
+    }
+}
+
+static bool lexer_check_read_file(const char *filename, buffer_s *buf)
+{
+    FILE *fp = fopen(filename, "rb");
+    if (!fp)
+    {
+        perror(filename);
+        return false;
+    }
+
+    char data[4096];
+    size_t size = 0;
+    while ((size = fread(data, 1, sizeof(data), fp)) > 0)
+    {
+        buffer_write_bytes(buf, data, size);
+    }
+    fclose(fp);
+    return true;
+}
+
+static void lexer_check_print_token(lex_process_s *lex_process, token_s *token)
+{
+    printf("%i %i %u+%u %i:%i ws=%i br=%i", token->type, token->flags, token->slice.offset, token->slice.length,
+           token->pos.line, token->pos.col, token->whitespace, token->between_brackets);
+    switch (token->type)
+    {
+    case TOKEN_TYPE_IDENTIFIER:
+    case TOKEN_TYPE_STRING:
+        printf(" sid=%u", token->sid);
+        break;
+    case TOKEN_TYPE_KEYWORD:
+        printf(" sid=%u keyword=%i", token->sid, token->keyword);
+        break;
+    case TOKEN_TYPE_OPERATOR:
+        printf(" op=%i", token->op);
+        break;
+    case TOKEN_TYPE_NUMBER:
+        printf(" value=%llu type=%i", token->llnum, token->num.type);
+        break;
+    case TOKEN_TYPE_SYMBOL:
+        printf(" c=%i", token->cval);
+        break;
+    default:
+        break;
+    }
+
+    size_t len = 0;
+    const char *text = lex_process_token_text(lex_process, token, &len);
+    printf(" [");
+    fwrite(text, 1, len, stdout);
+    printf("]\n");
+}
+
+static void lexer_check_lex(const char *name, buffer_s *buf, diagnostics_s *diagnostics)
+{
+    compile_options_s options = {0};
+    compile_process_s *compiler = compile_process_create_without_file(&options);
+    compiler->diagnostics = diagnostics;
+    lex_process_s *lex_process = lex_process_create(compiler, &lexer_string_buffer_functions, buf);
+
+    int res = lex(lex_process);
+    printf("== %s %i\n", name, res);
+    vector_s *tokens = lex_process_tokens(lex_process);
+    for (int i = 0; i < vector_count(tokens); i++)
+    {
+        lexer_check_print_token(lex_process, vector_at(tokens, i));
+    }
+    for (int i = 0; i < vector_count(lex_process->brackets); i++)
+    {
+        lex_brackets_s *brackets = vector_at(lex_process->brackets, i);
+        printf("brackets %zu %zu\n", brackets->start, brackets->end);
+    }
+    diagnostics_print(diagnostics, stdout);
+    diagnostics_clear(diagnostics);
+
+    lex_process_free(lex_process);
+    compile_process_free(compiler);
+}
+
+int main(int argc, char **argv)
+{
+    int total_random = 0;
+    int first_file = 1;
+    if (argc > 2 && S_EQ(argv[1], "--random"))
+    {
+        total_random = atoi(argv[2]);
+        first_file = 3;
+    }
+
+    diagnostics_s *diagnostics = diagnostics_create(DIAGNOSTICS_DEFAULT_CAPACITY, DIAGNOSTICS_DEFAULT_TEXT_SIZE);
+    for (int i = first_file; i < argc; i++)
+    {
+        buffer_s *buf = buffer_create();
+        if (!lexer_check_read_file(argv[i], buf))
+        {
+            return 1;
+        }
+        lexer_check_lex(argv[i], buf, diagnostics);
+        buffer_free(buf);
+    }
+
+    for (int i = 0; i < total_random; i++)
+    {
+        buffer_s *buf = buffer_create();
+        lexer_check_random_input(buf);
+        char name[32];
+        snprintf(name, sizeof(name), "random %i", i);
+        lexer_check_lex(name, buf, diagnostics);
+        buffer_free(buf);
+    }
+
+    diagnostics_free(diagnostics);
+    return 0;
+}
@@ -0,0 +1,142 @@
+#include "compiler.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// Generates the character class map and the state transitions the lexer
+// dispatches tokens with, see lexer_class_e. make check compares the tokens
+// they produce with those of the switch dispatch they replaced.
+// Usage: lexer_gen output.h
+
+struct lexer_gen_class
+{
+    lexer_class_e class;
+    const char *chars;
+};
+
+struct lexer_gen_transition
+{
+    lexer_state_e state;
+    lexer_class_e class;
+    int next;
+};
+
+// Later entries win, so '.' leaves the operators for a class of its own
+static const struct lexer_gen_class lexer_gen_classes[] =
+{
+    {LEXER_CLASS_DIGIT, "0123456789"},
+    {LEXER_CLASS_LETTER, "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz_"},
+    {LEXER_CLASS_OPERATOR, "+-><^%!=~|&([,.?"},
+    {LEXER_CLASS_DOT, "."},
+    {LEXER_CLASS_STAR, "*"},
+    {LEXER_CLASS_SLASH, "/"},
+    {LEXER_CLASS_SYMBOL, "{}:;#\\)]"},
+    {LEXER_CLASS_DOUBLE_QUOTE, "\""},
+    {LEXER_CLASS_SINGLE_QUOTE, "'"},
+    {LEXER_CLASS_WHITESPACE, " \t"},
+    {LEXER_CLASS_NEWLINE, "\n"},
+};
+
+// Every state runs its default action for the classes not listed here
+static const int lexer_gen_defaults[LEXER_STATE_COUNT] =
+{
+    [LEXER_STATE_START] = LEXER_ACTION(LEXER_ACTION_INVALID),
+    [LEXER_STATE_SLASH] = LEXER_ACTION(LEXER_ACTION_DIVISION),
+    [LEXER_STATE_DOT] = LEXER_ACTION(LEXER_ACTION_DOT),
+};
+
+static const struct lexer_gen_transition lexer_gen_transitions[] =
+{
+    {LEXER_STATE_START, LEXER_CLASS_DIGIT, LEXER_ACTION(LEXER_ACTION_NUMBER)},
+    {LEXER_STATE_START, LEXER_CLASS_LETTER, LEXER_ACTION(LEXER_ACTION_IDENTIFIER)},
+    {LEXER_STATE_START, LEXER_CLASS_OPERATOR, LEXER_ACTION(LEXER_ACTION_OPERATOR_OR_STRING)},
+    {LEXER_STATE_START, LEXER_CLASS_STAR, LEXER_ACTION(LEXER_ACTION_OPERATOR_OR_STRING)},
+    {LEXER_STATE_START, LEXER_CLASS_SLASH, LEXER_STATE_SLASH},
+    {LEXER_STATE_START, LEXER_CLASS_DOT, LEXER_STATE_DOT},
+    {LEXER_STATE_START, LEXER_CLASS_SYMBOL, LEXER_ACTION(LEXER_ACTION_SYMBOL)},
+    {LEXER_STATE_START, LEXER_CLASS_DOUBLE_QUOTE, LEXER_ACTION(LEXER_ACTION_STRING)},
+    {LEXER_STATE_START, LEXER_CLASS_SINGLE_QUOTE, LEXER_ACTION(LEXER_ACTION_QUOTE)},
+    {LEXER_STATE_START, LEXER_CLASS_WHITESPACE, LEXER_ACTION(LEXER_ACTION_WHITESPACE)},
+    {LEXER_STATE_START, LEXER_CLASS_NEWLINE, LEXER_ACTION(LEXER_ACTION_NEWLINE)},
+    {LEXER_STATE_START, LEXER_CLASS_EOF, LEXER_ACTION(LEXER_ACTION_END)},
+    {LEXER_STATE_SLASH, LEXER_CLASS_SLASH, LEXER_ACTION(LEXER_ACTION_LINE_COMMENT)},
+    {LEXER_STATE_SLASH, LEXER_CLASS_STAR, LEXER_ACTION(LEXER_ACTION_BLOCK_COMMENT)},
+    {LEXER_STATE_DOT, LEXER_CLASS_DIGIT, LEXER_ACTION(LEXER_ACTION_NUMBER)},
+};
+
+static unsigned char lexer_char_class[256];
+static unsigned char lexer_transitions[LEXER_STATE_COUNT][LEXER_CLASS_COUNT];
+
+static void lexer_gen_build()
+{
+    for (size_t i = 0; i < sizeof(lexer_gen_classes) / sizeof(lexer_gen_classes[0]); i++)
+    {
+        for (const char *c = lexer_gen_classes[i].chars; *c; c++)
+        {
+            lexer_char_class[(unsigned char)*c] = lexer_gen_classes[i].class;
+        }
+    }
+    // The lexer peeks EOF as a char
+    lexer_char_class[(unsigned char)EOF] = LEXER_CLASS_EOF;
+
+    for (int state = 0; state < LEXER_STATE_COUNT; state++)
+    {
+        for (int class = 0; class < LEXER_CLASS_COUNT; class++)
+        {
+            lexer_transitions[state][class] = lexer_gen_defaults[state];
+        }
+    }
+
+    for (size_t i = 0; i < sizeof(lexer_gen_transitions) / sizeof(lexer_gen_transitions[0]); i++)
+    {
+        const struct lexer_gen_transition *transition = &lexer_gen_transitions[i];
+        lexer_transitions[transition->state][transition->class] = transition->next;
+    }
+}
+
+static void lexer_gen_write(FILE *fp)
+{
+    fprintf(fp, "// Generated by tools/lexer_gen.c, do not edit\n");
+    fprintf(fp, "#ifndef LEXER_TABLES_H\n#define LEXER_TABLES_H\n\n");
+
+    fprintf(fp, "// lexer_class_e of every character\n");
+    fprintf(fp, "static const unsigned char lexer_char_class[256] =\n{");
+    for (int c = 0; c < 256; c++)
+    {
+        fprintf(fp, "%s%2i,", c % 16 ? " " : "\n    ", lexer_char_class[c]);
+    }
+    fprintf(fp, "\n};\n\n");
+
+    fprintf(fp, "// Next state or LEXER_ACTION of every state and lexer_class_e\n");
+    fprintf(fp, "static const unsigned char lexer_transitions[LEXER_STATE_COUNT][LEXER_CLASS_COUNT] =\n{\n");
+    for (int state = 0; state < LEXER_STATE_COUNT; state++)
+    {
+        fprintf(fp, "    {");
+        for (int class = 0; class < LEXER_CLASS_COUNT; class++)
+        {
+            fprintf(fp, "%s%2i", class ? ", " : "", lexer_transitions[state][class]);
+        }
+        fprintf(fp, "},\n");
+    }
+    fprintf(fp, "};\n\n#endif\n");
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "usage: %s output.h\n", argv[0]);
+        return 1;
+    }
+
+    lexer_gen_build();
+
+    FILE *fp = fopen(argv[1], "w");
+    if (!fp)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    lexer_gen_write(fp);
+    return fclose(fp) == 0 ? 0 : 1;
+}